@@ -0,0 +1,314 @@
+/**
+ *  @filename   :   bench.c
+ *  @brief      :   Transfer benchmarks for the epd2in13 driver
+ *
+ *  Flash with `make bench flash-bench` and read the results on the UART at
+ *  38400 baud. Each case streams one plane (EPD_WIDTH * EPD_HEIGHT / 8 bytes)
+ *  into DATA_START_TRANSMISSION_1 without refreshing the panel, "frame"
+ *  streams both planes like epd_display_frame_direct. The dashboard cases
+ *  update BENCH_FIELDS small windows and do refresh, once per field the way
+ *  demo.c works and once for all of them in a transaction. The gate scan
+ *  cases refresh a single window in partial mode and report the BUSY time
+ *  for each scan mode and window size. The profile cases report the BUSY
+ *  time of a full refresh with each bundled waveform. Both print only the
+ *  BUSY time, bytes and rate don't apply to a refresh. The results are only
+ *  printed at the end since the usart backend shares USART0 with the UART.
+ *  Build once per backend (EPD_IF=spi|usart|bitbang) to compare them.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+#include "clock.h"
+#include "demo-imagedata.h"
+#include "epd2in13.h"
+#include "epdlut.h"
+#include "epdpaint.h"
+#include "uart.h"
+
+#define BENCH_PLANE_BYTES   (EPD_WIDTH * EPD_HEIGHT / 8)
+#define BENCH_ROWS          16
+#define BENCH_RESULTS       24
+#define BENCH_FIELDS        4
+#define BENCH_FIELD_X       40
+#define BENCH_FIELD_WIDTH   24
+#define BENCH_FIELD_ROWS    48
+#define BENCH_FIELD_PITCH   52
+#define BENCH_FIELD_BYTES   (BENCH_FIELD_WIDTH / 8 * BENCH_FIELD_ROWS)
+
+struct bench_result {
+    const char* name;
+    uint32_t bytes;
+    uint32_t us;
+    unsigned char refresh;      // us is BUSY time, bytes don't apply
+};
+
+struct bench_result bench_results[BENCH_RESULTS];
+unsigned char bench_count;
+
+unsigned char bench_buffer[EPD_WIDTH / 8 * BENCH_ROWS];
+unsigned char bench_band[2][EPD_WIDTH / 8 * BENCH_ROWS];
+
+static void bench_report(const char* name, uint32_t bytes, uint32_t us) {
+    if (bench_count < BENCH_RESULTS) {
+        bench_results[bench_count].name = name;
+        bench_results[bench_count].bytes = bytes;
+        bench_results[bench_count].us = us;
+        bench_results[bench_count].refresh = 0;
+        bench_count++;
+    }
+}
+
+/**
+ *  @brief: a refresh, only its BUSY time means anything
+ */
+static void bench_report_refresh(const char* name, uint32_t busy_us) {
+    if (bench_count < BENCH_RESULTS) {
+        bench_report(name, 0, busy_us);
+        bench_results[bench_count - 1].refresh = 1;
+    }
+}
+
+static void bench_print(void) {
+    uart_init(38400);
+    stdout = &uart_stdout;
+    printf("epd2in13 transfer benchmark, %s backend\n", epd_if_backend);
+    for (unsigned char i = 0; i < bench_count; i++) {
+        struct bench_result * r = &bench_results[i];
+        if (r->refresh) {
+            printf("%-20s BUSY %8lu ms\n", r->name, r->us / 1000);
+        } else if (r->us == 0) {
+            printf("%-20s %6lu bytes %8lu us\n", r->name, r->bytes, r->us);
+        } else {
+            printf("%-20s %6lu bytes %8lu us %8lu B/s\n",
+                r->name, r->bytes, r->us, (uint32_t)((uint64_t)r->bytes * 1000000UL / r->us));
+        }
+    }
+}
+
+/**
+ *  @brief: the original path, one epd_send_data call per byte
+ */
+static void bench_per_byte(struct epd * epd) {
+    uint32_t start = clock_us();
+    epd_send_command(epd, DATA_START_TRANSMISSION_1);
+    for (int i = 0; i < BENCH_PLANE_BYTES; i++) {
+        epd_send_data(epd, pgm_read_byte(&IMAGE_BLACK[i]));
+    }
+    bench_report("per byte (PROGMEM)", BENCH_PLANE_BYTES, clock_us() - start);
+}
+
+static void bench_block_P(struct epd * epd) {
+    uint32_t start = clock_us();
+    epd_send_command(epd, DATA_START_TRANSMISSION_1);
+    epd_send_data_block_P(epd, IMAGE_BLACK, BENCH_PLANE_BYTES);
+    bench_report("block (PROGMEM)", BENCH_PLANE_BYTES, clock_us() - start);
+}
+
+static void bench_frame(struct epd * epd) {
+    uint32_t start = clock_us();
+    epd_send_command(epd, DATA_START_TRANSMISSION_1);
+    epd_send_data_block_P(epd, IMAGE_BLACK, BENCH_PLANE_BYTES);
+    epd_send_command(epd, DATA_START_TRANSMISSION_2);
+    epd_send_data_block_P(epd, IMAGE_RED, BENCH_PLANE_BYTES);
+    bench_report("frame (PROGMEM)", 2UL * BENCH_PLANE_BYTES, clock_us() - start);
+}
+
+static void bench_block(struct epd * epd) {
+    uint32_t bytes = 0;
+    uint32_t start = clock_us();
+    epd_send_command(epd, DATA_START_TRANSMISSION_1);
+    while (bytes + sizeof(bench_buffer) <= BENCH_PLANE_BYTES) {
+        epd_send_data_block(epd, bench_buffer, sizeof(bench_buffer));
+        bytes += sizeof(bench_buffer);
+    }
+    bench_report("block (RAM)", bytes, clock_us() - start);
+}
+
+static void bench_fill(struct epd * epd) {
+    uint32_t start = clock_us();
+    epd_send_command(epd, DATA_START_TRANSMISSION_1);
+    epd_send_data_fill(epd, 0xFF, BENCH_PLANE_BYTES);
+    bench_report("fill", BENCH_PLANE_BYTES, clock_us() - start);
+}
+
+/**
+ *  @brief: rasterize one band of text, stands in for real application drawing
+ */
+static void bench_render_band(struct paint * paint, unsigned char * band, int n) {
+    paint_init(paint, band, EPD_WIDTH, BENCH_ROWS);
+    paint_Clear(paint, 1);
+    paint_DrawStringAt(paint, 0, 2, "band", &Font12, 0);
+    paint_DrawFilledRectangle(paint, 40, 2, 40 + n, 12, 0);
+}
+
+/**
+ *  @brief: render a band then send it, one after the other
+ */
+static void bench_bands_serial(struct epd * epd) {
+    struct paint paint;
+    uint32_t bytes = 0;
+    uint32_t start = clock_us();
+    epd_send_command(epd, DATA_START_TRANSMISSION_1);
+    for (int n = 0; bytes + sizeof(bench_band[0]) <= BENCH_PLANE_BYTES; n++) {
+        bench_render_band(&paint, bench_band[0], n);
+        epd_send_data_block(epd, bench_band[0], sizeof(bench_band[0]));
+        bytes += sizeof(bench_band[0]);
+    }
+    bench_report("bands serial", bytes, clock_us() - start);
+}
+
+/**
+ *  @brief: render the next band while the queue shifts out the previous one
+ */
+static void bench_bands_queued(struct epd * epd) {
+    struct paint paint;
+    uint32_t bytes = 0;
+    uint32_t start = clock_us();
+    epd_send_command(epd, DATA_START_TRANSMISSION_1);
+    for (int n = 0; bytes + sizeof(bench_band[0]) <= BENCH_PLANE_BYTES; n++) {
+        unsigned char * band = bench_band[n & 1];
+        bench_render_band(&paint, band, n);
+        /* the other band must be out before this one may be reused */
+        epd_if_spi_wait();
+        epd_if_spi_queue_block(HIGH, band, sizeof(bench_band[0]));
+        bytes += sizeof(bench_band[0]);
+    }
+    epd_if_spi_wait();
+    bench_report("bands queued", bytes, clock_us() - start);
+}
+
+/**
+ *  @brief: new field contents, so the band hashes don't skip the upload
+ */
+static void bench_invert_buffer(void) {
+    for (unsigned int i = 0; i < sizeof(bench_buffer); i++) {
+        bench_buffer[i] = ~bench_buffer[i];
+    }
+}
+
+/**
+ *  @brief: every field uploaded and refreshed on its own
+ */
+static void bench_dashboard_separate(struct epd * epd) {
+    bench_invert_buffer();
+    uint32_t start = clock_us();
+    for (unsigned char i = 0; i < BENCH_FIELDS; i++) {
+        epd_set_partial_window_black(epd, bench_buffer,
+            BENCH_FIELD_X, i * BENCH_FIELD_PITCH, BENCH_FIELD_WIDTH, BENCH_FIELD_ROWS);
+        epd_display_frame(epd);
+    }
+    bench_report("dashboard separate", (uint32_t)BENCH_FIELDS * BENCH_FIELD_BYTES, clock_us() - start);
+}
+
+/**
+ *  @brief: the same fields in one transaction with a single refresh
+ */
+static void bench_dashboard_transaction(struct epd * epd) {
+    bench_invert_buffer();
+    uint32_t start = clock_us();
+    epd_begin(epd);
+    for (unsigned char i = 0; i < BENCH_FIELDS; i++) {
+        epd_add_window(epd, bench_buffer, NULL,
+            BENCH_FIELD_X, i * BENCH_FIELD_PITCH, BENCH_FIELD_WIDTH, BENCH_FIELD_ROWS);
+    }
+    epd_commit(epd);
+    bench_report("dashboard transaction", (uint32_t)BENCH_FIELDS * BENCH_FIELD_BYTES, clock_us() - start);
+}
+
+struct bench_window {
+    const char* name;
+    unsigned char gate_scan;
+    unsigned int w;
+    unsigned int l;
+};
+
+/* window sizes up to what bench_buffer holds, in both scan modes */
+static const struct bench_window bench_windows[] = {
+    { "scan all 16x16",     EPD_GATE_SCAN_ALL,      16, 16 },
+    { "scan inside 16x16",  EPD_GATE_SCAN_INSIDE,   16, 16 },
+    { "scan all 32x32",     EPD_GATE_SCAN_ALL,      32, 32 },
+    { "scan inside 32x32",  EPD_GATE_SCAN_INSIDE,   32, 32 },
+    { "scan all 104x16",    EPD_GATE_SCAN_ALL,      104, 16 },
+    { "scan inside 104x16", EPD_GATE_SCAN_INSIDE,   104, 16 },
+};
+
+/**
+ *  @brief: BUSY time of a partial refresh per gate scan mode and size
+ */
+static void bench_gate_scan(struct epd * epd) {
+    for (unsigned char i = 0; i < sizeof(bench_windows) / sizeof(bench_windows[0]); i++) {
+        const struct bench_window * window = &bench_windows[i];
+        bench_invert_buffer();
+        epd_set_gate_scan(epd, window->gate_scan);
+        epd_set_partial_window_black(epd, bench_buffer, 0, 96, window->w, window->l);
+        epd_display_window(epd, 0, 96, window->w, window->l);
+        bench_report_refresh(window->name, epd->busy_us);
+    }
+    epd_set_gate_scan(epd, EPD_GATE_SCAN_ALL);
+}
+
+/**
+ *  @brief: BUSY time of a full frame refresh with each bundled waveform
+ */
+static void bench_profiles(struct epd * epd) {
+    epd_set_profile(epd, &epd_profile_fast_bw);
+    epd_force_refresh(epd);
+    epd_display_frame_direct(epd, IMAGE_BLACK, NULL);
+    bench_report_refresh("refresh fast b/w", epd->busy_us);
+
+    epd_set_profile(epd, &epd_profile_cool_bw);
+    epd_force_refresh(epd);
+    epd_display_frame_direct(epd, IMAGE_BLACK, NULL);
+    bench_report_refresh("refresh cool b/w", epd->busy_us);
+
+    epd_set_profile(epd, &epd_profile_cold_bw);
+    epd_force_refresh(epd);
+    epd_display_frame_direct(epd, IMAGE_BLACK, NULL);
+    bench_report_refresh("refresh cold b/w", epd->busy_us);
+
+    epd_set_profile(epd, &epd_profile_otp);
+    epd_force_refresh(epd);
+    epd_display_frame_direct(epd, IMAGE_BLACK, IMAGE_RED);
+    bench_report_refresh("refresh otp", epd->busy_us);
+
+    /* red unchanged since the OTP refresh */
+    epd_set_bw_refresh(epd, &epd_profile_keep_red);
+    bench_invert_buffer();
+    epd_set_partial_window_black(epd, bench_buffer, 0, 96, 32, 32);
+    epd_display_frame(epd);
+    bench_report_refresh("refresh keep red", epd->busy_us);
+    epd_set_bw_refresh(epd, NULL);
+}
+
+int main() {
+    struct epd epd;
+
+    clock_init();
+    epd_init(&epd);
+
+    for (unsigned int i = 0; i < sizeof(bench_buffer); i++) {
+        bench_buffer[i] = i;
+    }
+
+    bench_per_byte(&epd);
+    bench_block_P(&epd);
+    bench_frame(&epd);
+    bench_block(&epd);
+    bench_fill(&epd);
+    bench_bands_serial(&epd);
+    bench_bands_queued(&epd);
+    bench_dashboard_separate(&epd);
+    bench_dashboard_transaction(&epd);
+    bench_gate_scan(&epd);
+    bench_profiles(&epd);
+
+    epd_sleep(&epd);
+    bench_print();
+    while (1);
+
+    return 0;
+}
+
+/* END OF FILE */
@@ -0,0 +1,99 @@
+/**
+ *  @filename   :   characterise.c
+ *  @brief      :   Refresh time of every bundled profile on this panel
+ *
+ *  Flash with `make characterise flash-characterise` and read the table on
+ *  the UART at 38400 baud. Each profile in epd_profiles refreshes the demo
+ *  image with its name on top and holds it CHARACTERISE_HOLD_MS to judge
+ *  the contrast by eye, then refreshes to white. Both BUSY times go into
+ *  the table, black/white profiles only show the black plane. Like the
+ *  bench the table is only printed at the end since the usart backend
+ *  shares USART0 with the UART.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <avr/pgmspace.h>
+#include <util/delay.h>
+
+#include "clock.h"
+#include "demo-imagedata.h"
+#include "epd2in13.h"
+#include "epdlut.h"
+#include "epdpaint.h"
+#include "uart.h"
+
+#define COLORED                 0
+#define UNCOLORED               1
+
+#define CHARACTERISE_HOLD_MS    5000
+#define CHARACTERISE_LABEL_ROWS 12
+
+struct characterise_result {
+    uint32_t image_us;
+    uint32_t white_us;
+};
+
+struct characterise_result characterise_results[EPD_PROFILES];
+
+unsigned char characterise_label[EPD_WIDTH / 8 * CHARACTERISE_LABEL_ROWS];
+
+static void characterise_print(void) {
+    uart_init(38400);
+    stdout = &uart_stdout;
+    printf("epd2in13 refresh characterisation, %s backend\n", epd_if_backend);
+    printf("%-20s %8s %8s\n", "profile", "image ms", "white ms");
+    for (unsigned char i = 0; i < EPD_PROFILES; i++) {
+        printf("%-20s %8lu %8lu\n", epd_profiles[i].name,
+            characterise_results[i].image_us / 1000, characterise_results[i].white_us / 1000);
+    }
+}
+
+/**
+ *  @brief: the image and its label with one profile, then back to white
+ */
+static void characterise_profile(struct epd * epd, unsigned char i) {
+    const struct epd_profile* profile = epd_profiles[i].profile;
+    int bw = profile->panel_setting & EPD_PANEL_BW;
+    struct paint paint;
+    struct epd_source black;
+    struct epd_source red;
+    struct epd_source white;
+
+    epd_set_profile(epd, profile);
+    epd_force_refresh(epd);
+    epd_source_P(&black, IMAGE_BLACK);
+    epd_source_P(&red, IMAGE_RED);
+    epd_set_window(epd, &black, bw ? NULL : &red, 0, 0, EPD_WIDTH, EPD_HEIGHT);
+    paint_init(&paint, characterise_label, EPD_WIDTH, CHARACTERISE_LABEL_ROWS);
+    paint_Clear(&paint, UNCOLORED);
+    paint_DrawStringAt(&paint, 2, 2, epd_profiles[i].name, &Font8, COLORED);
+    epd_set_partial_window_black(epd, characterise_label, 0, 0, EPD_WIDTH, CHARACTERISE_LABEL_ROWS);
+    epd_display_frame(epd);
+    characterise_results[i].image_us = epd->busy_us;
+    _delay_ms(CHARACTERISE_HOLD_MS);
+
+    epd_source_fill(&white, 0xFF);
+    epd_display_frame_source(epd, &white, bw ? NULL : &white);
+    characterise_results[i].white_us = epd->busy_us;
+}
+
+int main() {
+    struct epd epd;
+
+    clock_init();
+    epd_init(&epd);
+
+    for (unsigned char i = 0; i < EPD_PROFILES; i++) {
+        characterise_profile(&epd, i);
+    }
+
+    epd_set_profile(&epd, NULL);
+    epd_sleep(&epd);
+    characterise_print();
+    while (1);
+
+    return 0;
+}
+
+/* END OF FILE */
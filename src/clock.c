@@ -0,0 +1,88 @@
+/**
+ *  @filename   :   clock.c
+ *  @brief      :   Free running microsecond and millisecond clock on Timer1
+ *
+ *  Timer1 runs at F_CPU/8 and only interrupts on overflow, so the clock costs
+ *  one short interrupt every 65536 ticks. Microseconds wrap after ~71 minutes,
+ *  milliseconds after ~49 days; always compare times by subtraction.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "clock.h"
+
+#if F_CPU % 8000000UL
+#error "clock.c expects F_CPU to be a multiple of 8 MHz"
+#endif
+
+#define CLOCK_TICKS_PER_US  (F_CPU / 8000000UL)
+#define CLOCK_US_PER_OVF    (65536UL / CLOCK_TICKS_PER_US)
+
+static volatile uint32_t clock_overflows;
+static volatile uint32_t clock_ms_count;
+static volatile uint16_t clock_us_rem;
+
+ISR(TIMER1_OVF_vect) {
+    clock_overflows++;
+    clock_ms_count += CLOCK_US_PER_OVF / 1000;
+    clock_us_rem += CLOCK_US_PER_OVF % 1000;
+    if (clock_us_rem >= 1000) {
+        clock_us_rem -= 1000;
+        clock_ms_count++;
+    }
+}
+
+void clock_init(void) {
+    if (TCCR1B != 0) {
+        return;
+    }
+    TCCR1A = 0;
+    TCCR1B = (1<<CS11);
+    TCNT1 = 0;
+    TIMSK1 = (1<<TOIE1);
+    sei();
+}
+
+/**
+ *  @brief: read the overflow count and TCNT1 as one consistent value
+ */
+static uint16_t clock_snapshot(uint32_t * overflows) {
+    uint8_t sreg = SREG;
+    uint16_t ticks;
+
+    cli();
+    ticks = TCNT1;
+    *overflows = clock_overflows;
+    /* an overflow that hasn't been serviced yet belongs to this reading */
+    if ((TIFR1 & (1<<TOV1)) && ticks < 0x8000) {
+        (*overflows)++;
+    }
+    SREG = sreg;
+    return ticks;
+}
+
+uint32_t clock_us(void) {
+    uint32_t overflows;
+    uint16_t ticks = clock_snapshot(&overflows);
+
+    return overflows * CLOCK_US_PER_OVF + ticks / CLOCK_TICKS_PER_US;
+}
+
+uint32_t clock_ms(void) {
+    uint8_t sreg = SREG;
+    uint32_t ms;
+    uint32_t us;
+    uint16_t ticks;
+
+    cli();
+    ticks = TCNT1;
+    ms = clock_ms_count;
+    us = clock_us_rem + ticks / CLOCK_TICKS_PER_US;
+    if ((TIFR1 & (1<<TOV1)) && ticks < 0x8000) {
+        us += CLOCK_US_PER_OVF;
+    }
+    SREG = sreg;
+    return ms + us / 1000;
+}
+
+/* END OF FILE */
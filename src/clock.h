@@ -0,0 +1,17 @@
+/**
+ *  @filename   :   clock.h
+ *  @brief      :   Free running microsecond and millisecond clock on Timer1
+ */
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+
+void clock_init(void);
+uint32_t clock_us(void);
+uint32_t clock_ms(void);
+
+#endif
+
+/* END OF FILE */
@@ -26,48 +26,311 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <avr/pgmspace.h>
+#if EPD_BAND_HASHES
+#include <util/crc16.h>
+#endif
 #include "epd2in13.h"
-#include <util/delay.h>
 
+/* the panel running an asynchronous operation, NULL when there is none */
+static struct epd * volatile epd_async;
+static volatile epd_callback epd_async_done;
+static volatile unsigned char epd_async_deep_sleep;
+static volatile unsigned char epd_async_configure;
+/* set by the BUSY interrupt, the rest is finished in main context */
+static volatile unsigned char epd_async_finished;
+static volatile unsigned long epd_async_busy_us;
+
+/* steps of epd_power_on_async, the timed ones are advanced by epd_poll */
+#define EPD_BRING_UP_NONE       0
+#define EPD_BRING_UP_RESET      1   // RST held low
+#define EPD_BRING_UP_SETTLE     2   // RST released, controller coming out of reset
+#define EPD_BRING_UP_POWER_ON   3   // POWER_ON sent, the BUSY edge finishes it
+static volatile unsigned char epd_bring_up;
+static unsigned long epd_bring_up_ms;
+
+/**
+ *  Reset, then BUSY tells us when the controller is ready instead of a
+ *  fixed delay, and again when the booster has come up after POWER_ON.
+ *  Leaving deep sleep takes wake, power on and configure in that order,
+ *  POWER_OFF keeps the configuration so standby only needs power on.
+ */
+static const unsigned char epd_wake_sequence[] PROGMEM = {
+    EPD_SEQ_RESET,
+    EPD_SEQ_WAIT_BUSY,
+    EPD_SEQ_END
+};
+
+static const unsigned char epd_booster_sequence[] PROGMEM = {
+    EPD_SEQ_CMD(3), BOOSTER_SOFT_START, 0x17, 0x17, 0x17,
+    EPD_SEQ_END
+};
+
+static const unsigned char epd_power_on_sequence[] PROGMEM = {
+    EPD_SEQ_CMD(0), POWER_ON,
+    EPD_SEQ_WAIT_BUSY,
+    EPD_SEQ_END
+};
+
+/* PANEL_SETTING and VCOM_AND_DATA_INTERVAL_SETTING come from the profile */
+static const unsigned char epd_configure_sequence[] PROGMEM = {
+    EPD_SEQ_CMD(3), RESOLUTION_SETTING, 0x68, 0x00, 0xD4,   // width: 104, height: 212
+    EPD_SEQ_END
+};
+
+static const unsigned char epd_power_off_sequence[] PROGMEM = {
+    EPD_SEQ_CMD(0), POWER_OFF,
+    EPD_SEQ_WAIT_BUSY,
+    EPD_SEQ_END
+};
+
+static const unsigned char epd_deep_sleep_sequence[] PROGMEM = {
+    EPD_SEQ_CMD(1), DEEP_SLEEP, 0xA5,
+    EPD_SEQ_END
+};
+
+static void epd_forget_sram(struct epd * epd);
+static void epd_prepare_refresh(struct epd * epd);
 
 int epd_init(struct epd * epd) {
-    epd->reset_pin = RST_PIN;
-    epd->dc_pin = DC_PIN;
-    epd->cs_pin = CS_PIN;
-    epd->busy_pin = BUSY_PIN;
     epd->width = EPD_WIDTH;
     epd->height = EPD_HEIGHT;
+    epd->busy_us = 0;
+    epd->state = EPD_STATE_OFF;
+    epd->power_off_ms = 0;
+    epd->deep_sleep_ms = 0;
+    epd->partial = 0;
+    epd->transaction = 0;
+    epd->gate_scan = EPD_GATE_SCAN_ALL;
+    epd->box_refresh = 0;
+    epd->profile = NULL;
+    epd->bw_refresh = NULL;
+    epd->loaded = NULL;
+#if EPD_UNALIGNED_WINDOWS
+    epd->edge_next = 0;
+#endif
+    epd->temperature_bands = NULL;
+    epd->temperature_band_count = 0;
+    epd->temperature_band = 0;
+    epd->temperature = EPD_TEMPERATURE_UNKNOWN;
+    epd->temperature_ms = 0;
+    epd->temperature_interval_ms = 0;
+    epd_forget_sram(epd);
+    epd->dirty = 1;
+    memset(epd->sent, 0, sizeof(epd->sent));
 
     /* this calls the peripheral hardware interface, see epdif */
     if (epd_if_init() != 0) {
         return -1;
     }
-    /* EPD hardware init start */
-    epd_reset(epd);
-    epd_send_command(epd, BOOSTER_SOFT_START);
-    epd_send_data(epd, 0x17);
-    epd_send_data(epd, 0x17);
-    epd_send_data(epd, 0x17);
-    epd_send_command(epd, POWER_ON);
-    epd_wait_until_idle(epd);
+    epd_power_on(epd);
+    return 0;
+}
+
+/**
+ *  @brief: enter a state and restart the idle timeouts
+ */
+static void epd_set_state(struct epd * epd, unsigned char state) {
+    epd->state = state;
+    epd->last_active_ms = epd_if_millis();
+}
+
+static void epd_async_idle(unsigned long busy_us);
+static void epd_async_finish(struct epd * epd);
+
+/**
+ *  @brief: PANEL_SETTING, VCOM_AND_DATA_INTERVAL_SETTING, PLL_CONTROL and
+ *          the LUTs of a profile, NULL for the OTP waveform at 50 Hz
+ */
+static void epd_send_profile(struct epd * epd, const struct epd_profile* profile) {
     epd_send_command(epd, PANEL_SETTING);
-    epd_send_data(epd, 0x8F);
+    epd_send_data(epd, profile != NULL ? profile->panel_setting : EPD_PANEL_SETTING_OTP);
     epd_send_command(epd, VCOM_AND_DATA_INTERVAL_SETTING);
-    epd_send_data(epd, 0x37);
-    epd_send_command(epd, RESOLUTION_SETTING);
-    epd_send_data(epd, 0x68);     // width: 104
-    epd_send_data(epd, 0x00);
-    epd_send_data(epd, 0xD4);     // height: 212
-    /* EPD hardware init end */
-    return 0;
+    epd_send_data(epd, profile != NULL ? profile->vcom_data_interval : EPD_VCOM_DATA_INTERVAL_OTP);
+    epd_send_command(epd, PLL_CONTROL);
+    epd_send_data(epd, profile != NULL ? profile->pll : EPD_PLL_50HZ);
+    if (profile != NULL && profile->luts != NULL) {
+        epd_load_luts(epd, profile->luts);
+    }
+    epd->loaded = profile;
+}
+
+/**
+ *  @brief: set the panel up for the current profile, the LUT registers
+ *          are lost in deep sleep and reloaded with the rest
+ */
+static void epd_configure(struct epd * epd) {
+    epd_send_profile(epd, epd->profile);
+    epd_run_sequence(epd, epd_configure_sequence);
+}
+
+/**
+ *  @brief: 1 when the profile is black/white only
+ */
+static int epd_profile_bw(const struct epd_profile* profile) {
+    return profile != NULL && (profile->panel_setting & EPD_PANEL_BW);
+}
+
+/**
+ *  @brief: move an asynchronous bring-up on past the reset pulse. Without
+ *          block it only does what is already due and leaves the rest to
+ *          a later call, with block it waits out the timing. Once POWER_ON
+ *          is out the BUSY interrupt records its end.
+ */
+static void epd_bring_up_step(struct epd * epd, int block) {
+    unsigned long elapsed = epd_if_millis() - epd_bring_up_ms;
+
+    if (epd_bring_up == EPD_BRING_UP_RESET) {
+        if (elapsed < EPD_RESET_LOW_MS) {
+            if (!block) {
+                return;
+            }
+            epd_if_delay_ms(EPD_RESET_LOW_MS - elapsed);
+        }
+        epd_if_digital_write(RST_PIN, HIGH);
+        epd_bring_up_ms = epd_if_millis();
+        epd_bring_up = EPD_BRING_UP_SETTLE;
+        elapsed = 0;
+    }
+    if (epd_bring_up == EPD_BRING_UP_SETTLE) {
+        if (elapsed < EPD_RESET_SETTLE_MS) {
+            if (!block) {
+                return;
+            }
+            epd_if_delay_ms(EPD_RESET_SETTLE_MS - elapsed);
+        }
+        if (epd_if_digital_read(BUSY_PIN) == LOW) {
+            if (!block) {
+                return;
+            }
+            epd_wait_until_idle(epd);
+        }
+        epd_run_sequence(epd, epd_booster_sequence);
+        epd_bring_up = EPD_BRING_UP_POWER_ON;
+        epd_if_on_idle(epd_async_idle);
+        epd_send_command(epd, POWER_ON);
+    }
+}
+
+/**
+ *  @brief: let an asynchronous operation on this panel run to completion
+ */
+static void epd_wait_async(struct epd * epd) {
+    while (epd_async == epd) {
+        if (epd_async_finished) {
+            epd_async_finish(epd);
+        } else if (epd_bring_up == EPD_BRING_UP_RESET || epd_bring_up == EPD_BRING_UP_SETTLE) {
+            epd_bring_up_step(epd, 1);
+        } else {
+            epd_if_wait_until_idle();
+        }
+    }
+}
+
+/**
+ *  @brief: make sure the controller is out of reset or deep sleep and
+ *          configured, ready to take frame data. Doesn't power the panel.
+ */
+void epd_wake(struct epd * epd) {
+    epd_wait_async(epd);
+    if (epd->state <= EPD_STATE_DEEP_SLEEP) {
+        epd_run_sequence(epd, epd_wake_sequence);
+        epd_run_sequence(epd, epd_booster_sequence);
+        epd_configure(epd);
+        epd_set_state(epd, EPD_STATE_STANDBY);
+    } else {
+        epd_set_state(epd, epd->state);
+    }
+}
+
+/**
+ *  @brief: make sure the panel is powered and ready to refresh, doing only
+ *          the transitions needed from the current state
+ */
+void epd_power_on(struct epd * epd) {
+    epd_wait_async(epd);
+    if (epd->state <= EPD_STATE_DEEP_SLEEP) {
+        epd_run_sequence(epd, epd_wake_sequence);
+        epd_run_sequence(epd, epd_booster_sequence);
+        epd_run_sequence(epd, epd_power_on_sequence);
+        epd_configure(epd);
+    } else if (epd->state == EPD_STATE_STANDBY) {
+        epd_run_sequence(epd, epd_power_on_sequence);
+    }
+    epd_set_state(epd, EPD_STATE_POWERED);
+}
+
+/**
+ *  @brief: switch the panel power off, the controller stays configured
+ */
+void epd_power_off(struct epd * epd) {
+    epd_wait_async(epd);
+    if (epd->state == EPD_STATE_POWERED) {
+        epd_run_sequence(epd, epd_power_off_sequence);
+        epd_set_state(epd, EPD_STATE_STANDBY);
+    }
+}
+
+/**
+ *  @brief: power off after power_off_ms and enter deep sleep after
+ *          deep_sleep_ms without any panel activity, 0 disables either.
+ *          The timeouts are applied by epd_poll.
+ */
+void epd_set_idle_timeouts(
+    struct epd * epd,
+    unsigned long power_off_ms,
+    unsigned long deep_sleep_ms
+) {
+    epd->power_off_ms = power_off_ms;
+    epd->deep_sleep_ms = deep_sleep_ms;
+}
+
+/**
+ *  @brief: apply the idle timeouts and move epd_power_on_async along, call
+ *          this from the main loop. Updates that come in before the
+ *          timeout reuse the powered panel. With temperature bands the
+ *          sensor is read every interval while the panel is awake.
+ */
+void epd_poll(struct epd * epd) {
+    unsigned long idle_ms;
+
+    if (epd_async == epd) {
+        if (epd_async_finished) {
+            epd_async_finish(epd);
+        } else {
+            epd_bring_up_step(epd, 0);
+        }
+        return;
+    }
+    if (epd->transaction) {
+        return;
+    }
+    idle_ms = epd_if_millis() - epd->last_active_ms;
+    if (epd->temperature_bands != NULL && epd->temperature_interval_ms != 0 &&
+            epd->state >= EPD_STATE_STANDBY &&
+            epd_if_millis() - epd->temperature_ms >= epd->temperature_interval_ms) {
+        /* keep the reading fresh while awake, without restarting the timeouts */
+        unsigned long last_active_ms = epd->last_active_ms;
+        epd_read_temperature(epd);
+        epd->last_active_ms = last_active_ms;
+    }
+    if (epd->deep_sleep_ms != 0 && idle_ms >= epd->deep_sleep_ms &&
+            epd->state >= EPD_STATE_STANDBY) {
+        epd_sleep(epd);
+    } else if (epd->power_off_ms != 0 && idle_ms >= epd->power_off_ms &&
+            epd->state == EPD_STATE_POWERED) {
+        epd_run_sequence(epd, epd_power_off_sequence);
+        epd->state = EPD_STATE_STANDBY;
+    }
 }
 
 /**
  *  @brief: basic function for sending commands
  */
 void epd_send_command(struct epd * epd, unsigned char command) {
-    epd_if_digital_write(epd->dc_pin, LOW);
+    epd_if_spi_wait();
+    epd_if_digital_write(DC_PIN, LOW);
     epd_if_spi_transfer(command);
 }
 
@@ -75,18 +338,17 @@ void epd_send_command(struct epd * epd, unsigned char command) {
  *  @brief: basic function for sending data
  */
 void epd_send_data(struct epd * epd, unsigned char data) {
-    epd_if_digital_write(epd->dc_pin, HIGH);
+    epd_if_spi_wait();
+    epd_if_digital_write(DC_PIN, HIGH);
     epd_if_spi_transfer(data);
 }
 
 /**
- *  @brief: Wait until the busy_pin goes LOW
+ *  @brief: Wait until the busy_pin goes HIGH, sleeping until the edge.
+ *          The time spent busy is kept in epd->busy_us.
  */
 void epd_wait_until_idle(struct epd * epd) {
-    //LOW: busy, HIGH: idle
-    while(epd_if_digital_read(epd->busy_pin) == LOW) {
-        _delay_ms(100);
-    }
+    epd->busy_us = epd_if_wait_until_idle();
 }
 
 /**
@@ -96,203 +358,1338 @@ void epd_wait_until_idle(struct epd * epd) {
  */
 void epd_reset(struct epd * epd) {
     //module reset
-    epd_if_digital_write(epd->reset_pin, LOW);
-    _delay_ms(200);
-    epd_if_digital_write(epd->reset_pin, HIGH);
-    _delay_ms(200);
+    epd->partial = 0;
+    epd_if_digital_write(RST_PIN, LOW);
+    epd_if_delay_ms(EPD_RESET_LOW_MS);
+    epd_if_digital_write(RST_PIN, HIGH);
+    epd_if_delay_ms(EPD_RESET_SETTLE_MS);
+}
+
+/**
+ *  @brief: run a PROGMEM command sequence made of EPD_SEQ_* steps.
+ *          A command and its data go out as one burst straight from flash.
+ */
+void epd_run_sequence(struct epd * epd, const unsigned char* sequence) {
+    unsigned char op;
+
+    while ((op = pgm_read_byte(sequence++)) != EPD_SEQ_END) {
+        if (op == EPD_SEQ_RESET) {
+            epd_reset(epd);
+        } else if (op == EPD_SEQ_DELAY) {
+            epd_if_delay_ms(pgm_read_byte(sequence++));
+        } else if (op == EPD_SEQ_WAIT_BUSY) {
+            epd_wait_until_idle(epd);
+        } else {
+            unsigned char len = op & 0x1f;
+            epd_send_command(epd, pgm_read_byte(sequence++));
+            if (len != 0) {
+                epd_send_data_block_P(epd, sequence, len);
+                sequence += len;
+            }
+        }
+    }
+}
+
+
+/**
+ *  @brief: send a run of data bytes from RAM in a single burst
+ */
+void epd_send_data_block(struct epd * epd, const unsigned char* data, unsigned int len) {
+    epd_if_spi_transfer_block(HIGH, data, len);
+}
+
+/**
+ *  @brief: send a run of data bytes from PROGMEM in a single burst
+ */
+void epd_send_data_block_P(struct epd * epd, const unsigned char* data, unsigned int len) {
+    epd_if_spi_transfer_block_P(HIGH, data, len);
 }
 
+/**
+ *  @brief: send the same data byte len times in a single burst
+ */
+void epd_send_data_fill(struct epd * epd, unsigned char data, unsigned int len) {
+    epd_if_spi_transfer_fill(HIGH, data, len);
+}
+
+/**
+ *  @brief: the settling delay the reference code puts around uploads,
+ *          left out between the windows of a transaction
+ */
+static void epd_upload_delay(struct epd * epd) {
+    if (!epd->transaction) {
+        epd_if_delay_ms(2);
+    }
+}
 
 /**
- *  @brief: transmit partial data to the SRAM
+ *  @brief: enter partial mode and program the PARTIAL_WINDOW registers
  */
-void epd_set_partial_window(
+static void epd_set_partial_area(
     struct epd * epd,
-    const unsigned char* buffer_black,
-    const unsigned char* buffer_red,
-    int x,
-    int y,
-    int w,
-    int l
+    unsigned int x,
+    unsigned int y,
+    unsigned int w,
+    unsigned int l
 ) {
-    epd_send_command(epd, PARTIAL_IN);
+    unsigned char window[7];
+
+    window[0] = x & 0xf8;     // x should be the multiple of 8, the last 3 bit will always be ignored
+    window[1] = ((x & 0xf8) + w  - 1) | 0x07;
+    window[2] = y >> 8;
+    window[3] = y & 0xff;
+    window[4] = (y + l - 1) >> 8;
+    window[5] = (y + l - 1) & 0xff;
+    window[6] = epd->gate_scan;
+
+    if (!epd->partial) {
+        epd_send_command(epd, PARTIAL_IN);
+        epd->partial = 1;
+    }
     epd_send_command(epd, PARTIAL_WINDOW);
-    epd_send_data(epd, x & 0xf8);     // x should be the multiple of 8, the last 3 bit will always be ignored
-    epd_send_data(epd, ((x & 0xf8) + w  - 1) | 0x07);
-    epd_send_data(epd, y >> 8);
-    epd_send_data(epd, y & 0xff);
-    epd_send_data(epd, (y + l - 1) >> 8);
-    epd_send_data(epd, (y + l - 1) & 0xff);
-    epd_send_data(epd, 0x01);         // Gates scan both inside and outside of the partial window. (default)
-    _delay_ms(2);
-    epd_send_command(epd, DATA_START_TRANSMISSION_1);
-    if (buffer_black != NULL) {
-        for(int i = 0; i < w  / 8 * l; i++) {
-            epd_send_data(epd, buffer_black[i]);
+    epd_send_data_block(epd, window, sizeof(window));
+    epd_upload_delay(epd);
+}
+
+/**
+ *  @brief: leave partial mode if the controller is in it
+ */
+static void epd_partial_out(struct epd * epd) {
+    if (epd->partial) {
+        epd_send_command(epd, PARTIAL_OUT);
+        epd->partial = 0;
+    }
+}
+
+#if EPD_BAND_HASHES
+/**
+ *  @brief: CRC-16 of rows [row, row + rows) of a source, stride bytes each
+ */
+static unsigned int epd_source_hash(
+    const struct epd_source* source,
+    unsigned int row,
+    unsigned int rows,
+    unsigned int stride
+) {
+    unsigned int hash = 0xffff;
+    unsigned int len = rows * stride;
+    const unsigned char* data = source->data + row * stride;
+
+    if (source->kind == EPD_SOURCE_RAM) {
+        while (len--) {
+            hash = _crc_ccitt_update(hash, *data++);
+        }
+    } else if (source->kind == EPD_SOURCE_PGM) {
+        while (len--) {
+            hash = _crc_ccitt_update(hash, pgm_read_byte(data++));
+        }
+    } else if (source->kind == EPD_SOURCE_FILL) {
+        while (len--) {
+            hash = _crc_ccitt_update(hash, source->fill);
         }
     } else {
-        for(int i = 0; i < w  / 8 * l; i++) {
-            epd_send_data(epd, 0x00);
+        unsigned char buffer[EPD_WIDTH / 8];
+        while (rows--) {
+            source->rows(source->context, row++, buffer, stride);
+            for (unsigned int i = 0; i < stride; i++) {
+                hash = _crc_ccitt_update(hash, buffer[i]);
+            }
         }
     }
-    _delay_ms(2);
-    epd_send_command(epd, DATA_START_TRANSMISSION_2);
-    if (buffer_red != NULL) {
-        for(int i = 0; i < w  / 8 * l; i++) {
-            epd_send_data(epd, buffer_red[i]);
-        }
+    return hash;
+}
+#endif
+
+/**
+ *  @brief: send rows [row, row + rows) of a source, stride bytes each
+ */
+static void epd_source_send(
+    struct epd * epd,
+    const struct epd_source* source,
+    unsigned int row,
+    unsigned int rows,
+    unsigned int stride
+) {
+    if (source->kind == EPD_SOURCE_RAM) {
+        epd_send_data_block(epd, source->data + row * stride, rows * stride);
+    } else if (source->kind == EPD_SOURCE_PGM) {
+        epd_send_data_block_P(epd, source->data + row * stride, rows * stride);
+    } else if (source->kind == EPD_SOURCE_FILL) {
+        epd_send_data_fill(epd, source->fill, rows * stride);
     } else {
-        for(int i = 0; i < w  / 8 * l; i++) {
-            epd_send_data(epd, 0x00);
+        unsigned char buffer[EPD_WIDTH / 8];
+        while (rows--) {
+            source->rows(source->context, row++, buffer, stride);
+            epd_send_data_block(epd, buffer, stride);
         }
     }
-    _delay_ms(2);
-    epd_send_command(epd, PARTIAL_OUT);
 }
 
+/**
+ *  @brief: forget which bands the panel SRAM holds
+ */
+static void epd_forget_bands(struct epd * epd) {
+#if EPD_BAND_HASHES
+    struct epd_band* band = &epd->bands[0][0];
+    unsigned char n = 2 * EPD_BANDS;
+
+    while (n--) {
+        band->first = 0xff;
+        band->last = 0;
+        band++;
+    }
+#endif
+}
 
 /**
- *  @brief: transmit partial data to the black part of SRAM
+ *  @brief: forget everything about the panel SRAM, it doesn't survive
+ *          deep sleep
+ */
+static void epd_forget_sram(struct epd * epd) {
+    epd_forget_bands(epd);
+#if EPD_UNALIGNED_WINDOWS
+    for (unsigned char i = 0; i < EPD_EDGE_SLOTS; i++) {
+        epd->edges[i].column = 0xff;
+    }
+    memset(epd->written, 0xff, sizeof(epd->written));
+#endif
+    epd->red_dirty = 1;
+}
+
+/**
+ *  @brief: count rows [from, to) of a window w pixels wide into the bytes
+ *          sent per band
+ */
+static void epd_count_sent(struct epd * epd, unsigned int w, unsigned int from, unsigned int to) {
+    while (from < to) {
+        unsigned int index = from / EPD_BAND_ROWS;
+        unsigned int next = (index + 1) * EPD_BAND_ROWS;
+        unsigned int bytes = ((next < to ? next : to) - from) * (w / 8);
+
+        epd->sent[index] = epd->sent[index] + bytes > 0xff ? 0xff : epd->sent[index] + bytes;
+        from = next;
+    }
+}
+
+/**
+ *  @brief: grow the transaction's bounding box to cover byte columns
+ *          [first, last] of rows [top, bottom]
  */
-void epd_set_partial_window_black(
+static void epd_box_add(
     struct epd * epd,
-    const unsigned char* buffer_black,
+    unsigned char first,
+    unsigned char last,
+    unsigned char top,
+    unsigned char bottom
+) {
+    if (epd->box_first > epd->box_last) {
+        epd->box_first = first;
+        epd->box_last = last;
+        epd->box_top = top;
+        epd->box_bottom = bottom;
+        return;
+    }
+    epd->box_first = first < epd->box_first ? first : epd->box_first;
+    epd->box_last = last > epd->box_last ? last : epd->box_last;
+    epd->box_top = top < epd->box_top ? top : epd->box_top;
+    epd->box_bottom = bottom > epd->box_bottom ? bottom : epd->box_bottom;
+}
+
+/**
+ *  @brief: send rows [from, to) of a window on one plane. The whole frame
+ *          goes out as is, anything smaller through a partial window.
+ */
+static void epd_send_plane_rows(
+    struct epd * epd,
+    unsigned char command,
+    const struct epd_source* source,
     unsigned int x,
     unsigned int y,
     unsigned int w,
-    unsigned int l
+    unsigned int from,
+    unsigned int to
 ) {
-    epd_send_command(epd, PARTIAL_IN);
-    epd_send_command(epd, PARTIAL_WINDOW);
-    epd_send_data(epd, x & 0xf8);     // x should be the multiple of 8, the last 3 bit will always be ignored
-    epd_send_data(epd, ((x & 0xf8) + w  - 1) | 0x07);
-    epd_send_data(epd, y >> 8);
-    epd_send_data(epd, y & 0xff);
-    epd_send_data(epd, (y + l - 1) >> 8);
-    epd_send_data(epd, (y + l - 1) & 0xff);
-    epd_send_data(epd, 0x01);         // Gates scan both inside and outside of the partial window. (default)
-    _delay_ms(2);
-    epd_send_command(epd, DATA_START_TRANSMISSION_1);
-    if (buffer_black != NULL) {
-        for(int i = 0; i < w  / 8 * l; i++) {
-            epd_send_data(epd, buffer_black[i]);
-        }
+    epd_wake(epd);
+    epd->dirty = 1;
+    if (command == DATA_START_TRANSMISSION_2) {
+        epd->red_dirty = 1;
+    }
+    epd_count_sent(epd, w, from, to);
+    if (epd->transaction) {
+        epd_box_add(epd, x / 8, (x + w) / 8 - 1, from, to - 1);
+    }
+    if (x == 0 && w == epd->width && from == 0 && to == epd->height) {
+        epd_partial_out(epd);
+        epd_send_command(epd, command);
+        epd_upload_delay(epd);
+        epd_source_send(epd, source, from - y, to - from, w / 8);
+        epd_upload_delay(epd);
     } else {
-        for(int i = 0; i < w  / 8 * l; i++) {
-            epd_send_data(epd, 0x00);
+        epd_set_partial_area(epd, x, from, w, to - from);
+        epd_send_command(epd, command);
+        epd_source_send(epd, source, from - y, to - from, w / 8);
+        epd_upload_delay(epd);
+        if (!epd->transaction) {
+            epd_partial_out(epd);
         }
     }
-    _delay_ms(2);
-    epd_send_command(epd, PARTIAL_OUT);
 }
 
-
+#if EPD_BAND_HASHES
 /**
- *  @brief: transmit partial data to the black part of SRAM
+ *  @brief: stream one plane of a window, x and w in multiples of 8.
+ *          Row bands whose hash matches what the panel already holds are
+ *          left out and each run of changed bands goes out on its own.
+ *          Bands the window only partly covers are always sent.
  */
-void epd_set_partial_window_red(
+static void epd_send_plane(
     struct epd * epd,
-    const unsigned char* buffer_red,
+    unsigned char plane,
+    const struct epd_source* source,
     unsigned int x,
     unsigned int y,
     unsigned int w,
     unsigned int l
 ) {
-    epd_send_command(epd, PARTIAL_IN);
-    epd_send_command(epd, PARTIAL_WINDOW);
-    epd_send_data(epd, x & 0xf8);     // x should be the multiple of 8, the last 3 bit will always be ignored
-    epd_send_data(epd, ((x & 0xf8) + w  - 1) | 0x07);
-    epd_send_data(epd, y >> 8);
-    epd_send_data(epd, y & 0xff);
-    epd_send_data(epd, (y + l - 1) >> 8);
-    epd_send_data(epd, (y + l - 1) & 0xff);
-    epd_send_data(epd, 0x01);         // Gates scan both inside and outside of the partial window. (default)
-    _delay_ms(2);
-    epd_send_command(epd, DATA_START_TRANSMISSION_2);
-    if (buffer_red != NULL) {
-        for(int i = 0; i < w  / 8 * l; i++) {
-            epd_send_data(epd, buffer_red[i]);
+    unsigned char command = plane == 0 && !epd_profile_bw(epd->profile) ?
+        DATA_START_TRANSMISSION_1 : DATA_START_TRANSMISSION_2;
+    unsigned char first = x / 8;
+    unsigned char last = (x + w - 1) / 8;
+    unsigned int end = y + l;
+    unsigned int run = end;     // first row of the changed run being collected
+    unsigned int row = y;
+
+    while (row < end) {
+        unsigned int index = row / EPD_BAND_ROWS;
+        unsigned int next = (index + 1) * EPD_BAND_ROWS;
+        struct epd_band* band = &epd->bands[plane][index];
+        int changed = 1;
+
+        if (next > epd->height) {
+            next = epd->height;
         }
-    } else {
-        for(int i = 0; i < w  / 8 * l; i++) {
-            epd_send_data(epd, 0x00);
+        if (row == index * EPD_BAND_ROWS && next <= end) {
+            unsigned int hash = epd_source_hash(source, row - y, next - row, w / 8);
+            changed = hash != band->hash || first != band->first || last != band->last;
+            band->hash = hash;
+            band->first = first;
+            band->last = last;
+        } else {
+            band->first = 0xff;
+            band->last = 0;
+            next = next < end ? next : end;
         }
+        if (changed && run == end) {
+            run = row;
+        } else if (!changed && run != end) {
+            epd_send_plane_rows(epd, command, source, x, y, w, run, row);
+            run = end;
+        }
+        row = next;
+    }
+    if (run != end) {
+        epd_send_plane_rows(epd, command, source, x, y, w, run, end);
     }
-    _delay_ms(2);
-    epd_send_command(epd, PARTIAL_OUT);
 }
+#else
+/**
+ *  @brief: stream one plane of a window, x and w in multiples of 8
+ */
+static void epd_send_plane(
+    struct epd * epd,
+    unsigned char plane,
+    const struct epd_source* source,
+    unsigned int x,
+    unsigned int y,
+    unsigned int w,
+    unsigned int l
+) {
+    unsigned char command = plane == 0 && !epd_profile_bw(epd->profile) ?
+        DATA_START_TRANSMISSION_1 : DATA_START_TRANSMISSION_2;
+
+    epd_send_plane_rows(epd, command, source, x, y, w, y, y + l);
+}
+#endif
 
 /**
- * @brief: refresh and displays the frame
+ *  @brief: read one row of any source into a buffer, RAM and PGM sources
+ *          hold rows of len bytes
  */
-void epd_display_frame_direct(
+void epd_source_read_row(
+    const struct epd_source* source,
+    unsigned int row,
+    unsigned char* buffer,
+    unsigned int len
+) {
+    if (source->kind == EPD_SOURCE_RAM) {
+        memcpy(buffer, source->data + row * len, len);
+    } else if (source->kind == EPD_SOURCE_PGM) {
+        memcpy_P(buffer, source->data + row * len, len);
+    } else if (source->kind == EPD_SOURCE_FILL) {
+        memset(buffer, source->fill, len);
+    } else {
+        source->rows(source->context, row, buffer, len);
+    }
+}
+
+#if EPD_UNALIGNED_WINDOWS
+/**
+ *  @brief: the shadow slot holding a byte, NULL when none does
+ */
+static struct epd_edge* epd_edge_find(
     struct epd * epd,
-    const unsigned char* frame_buffer_black,
-    const unsigned char* frame_buffer_red
+    unsigned char plane,
+    unsigned char column,
+    unsigned int row
 ) {
-    if (frame_buffer_black != NULL) {
-        epd_send_command(epd, DATA_START_TRANSMISSION_1);
-        _delay_ms(2);
-        for (int i = 0; i < epd->width * epd->height / 8; i++) {
-            epd_send_data(epd, pgm_read_byte(&frame_buffer_black[i]));
+    for (unsigned char i = 0; i < EPD_EDGE_SLOTS; i++) {
+        struct epd_edge* edge = &epd->edges[i];
+        if (edge->column == column && edge->plane == plane &&
+                row >= edge->y && row < edge->y + edge->l) {
+            return edge;
         }
-        _delay_ms(2);
     }
-    if (frame_buffer_red != NULL) {
-        epd_send_command(epd, DATA_START_TRANSMISSION_2);
-        _delay_ms(2);
-        for (int i = 0; i < epd->width * epd->height / 8; i++) {
-            epd_send_data(epd, pgm_read_byte(&frame_buffer_red[i]));
+    return NULL;
+}
+
+/**
+ *  @brief: what the panel holds in a byte, from the edge shadow or else
+ *          the background of the plane. Only valid where epd_edge_known.
+ */
+static unsigned char epd_edge_byte(
+    struct epd * epd,
+    unsigned char plane,
+    unsigned char column,
+    unsigned int row
+) {
+    struct epd_edge* edge = epd_edge_find(epd, plane, column, row);
+
+    return edge != NULL ? edge->bytes[row - edge->y] : epd->background[plane];
+}
+
+/**
+ *  @brief: 1 when every byte of rows [y, y + l) of a column is known, in
+ *          the shadow or untouched since the last whole-plane fill
+ */
+static int epd_edge_known(
+    struct epd * epd,
+    unsigned char plane,
+    unsigned char column,
+    unsigned int y,
+    unsigned int l
+) {
+    for (unsigned int row = y; row < y + l; row++) {
+        if ((epd->written[plane][column] & (1 << (row / EPD_EDGE_ROWS))) &&
+                epd_edge_find(epd, plane, column, row) == NULL) {
+            return 0;
         }
-        _delay_ms(2);
     }
-    epd_send_command(epd, DISPLAY_REFRESH);
-    epd_wait_until_idle(epd);
+    return 1;
 }
 
-
 /**
- * @brief: clear the frame data from the SRAM, this won't refresh the display
+ *  @brief: columns [first, last] of rows [y, y + l) no longer hold the
+ *          background
  */
-void epd_clear_frame_memory(struct epd * epd) {
-    epd_send_command(epd, DATA_START_TRANSMISSION_1);
-    _delay_ms(2);
-    for(int i = 0; i < epd->width * epd->height / 8; i++) {
-        epd_send_data(epd, 0xFF);
+static void epd_edge_written(
+    struct epd * epd,
+    unsigned char plane,
+    unsigned char first,
+    unsigned char last,
+    unsigned int y,
+    unsigned int l
+) {
+    unsigned char groups = 0;
+
+    for (unsigned int group = y / EPD_EDGE_ROWS; group <= (y + l - 1) / EPD_EDGE_ROWS; group++) {
+        groups |= 1 << group;
     }
-    _delay_ms(2);
-    epd_send_command(epd, DATA_START_TRANSMISSION_2);
-    _delay_ms(2);
-    for(int i = 0; i < epd->width * epd->height / 8; i++) {
-        epd_send_data(epd, 0xFF);
+    for (unsigned char column = first; column <= last; column++) {
+        epd->written[plane][column] |= groups;
+    }
+}
+
+/**
+ *  @brief: drop shadowed bytes in columns [first, last] of rows
+ *          [y, y + l), a window has written over them
+ */
+static void epd_edge_drop(
+    struct epd * epd,
+    unsigned char plane,
+    unsigned char first,
+    unsigned char last,
+    unsigned int y,
+    unsigned int l
+) {
+    for (unsigned char i = 0; i < EPD_EDGE_SLOTS; i++) {
+        struct epd_edge* edge = &epd->edges[i];
+        if (edge->column != 0xff && edge->plane == plane &&
+                edge->column >= first && edge->column <= last &&
+                edge->y < y + l && y < edge->y + edge->l) {
+            edge->column = 0xff;
+        }
     }
-    _delay_ms(2);
 }
 
+/* a source shifted right onto a byte-aligned window */
+struct epd_shift {
+    struct epd * epd;
+    const struct epd_source* source;
+    unsigned char plane;
+    unsigned char column;       // first byte column of the aligned window
+    unsigned char shift;        // x & 7
+    unsigned char left_mask;    // bits of the first byte inside the window
+    unsigned char right_mask;   // bits of the last byte inside the window
+    unsigned int y;
+    unsigned int stride;        // source bytes per row
+};
 
 /**
- *  @brief: update the display
- *          there are 2 memory areas embedded in the e-paper display
- *          but once this function is called,
- *          the the next action of SetFrameMemory or ClearFrame will
- *          set the other memory area.
+ *  @brief: row generator for unaligned windows, shifts the source bits
+ *          into place and fills the edge bytes from what the panel holds
  */
-void epd_display_frame(struct epd * epd) {
-    epd_send_command(epd, DISPLAY_REFRESH);
-    epd_wait_until_idle(epd);
+static void epd_shift_row(void* context, unsigned int row, unsigned char* buffer, unsigned int len) {
+    struct epd_shift* shift = context;
+    unsigned char in[EPD_WIDTH / 8];
+    unsigned char carry = 0;
+    unsigned char first;
+    unsigned char last;
+
+    epd_source_read_row(shift->source, row, in, shift->stride);
+    for (unsigned int i = 0; i < len; i++) {
+        unsigned char b = i < shift->stride ? in[i] : 0;
+        buffer[i] = carry | (b >> shift->shift);
+        carry = b << (8 - shift->shift);
+    }
+    first = epd_edge_byte(shift->epd, shift->plane, shift->column, shift->y + row);
+    buffer[0] = (buffer[0] & shift->left_mask) | (first & ~shift->left_mask);
+    last = epd_edge_byte(shift->epd, shift->plane, shift->column + len - 1, shift->y + row);
+    buffer[len - 1] = (buffer[len - 1] & shift->right_mask) | (last & ~shift->right_mask);
 }
 
 /**
- *  @brief: After this command is transmitted, the chip would enter the
- *          deep-sleep mode to save power.
- *          The deep sleep mode would return to standby by hardware reset.
- *          You can use Init() to awaken
+ *  @brief: keep what an unaligned window left in one of its edge columns,
+ *          index 0 for the left edge and len - 1 for the right. Call it
+ *          before the shadow changes, the bytes are worked out from it.
+ *          A slot holding column avoid, which is still to be worked out,
+ *          isn't reused; when that leaves none the bytes aren't kept and
+ *          later windows sharing them are refused instead.
  */
-void epd_sleep(struct epd * epd) {
-    epd_send_command(epd, POWER_OFF);
-    epd_wait_until_idle(epd);
-    epd_send_command(epd, DEEP_SLEEP);
-    epd_send_data(epd, 0xA5);
+static void epd_edge_store(
+    struct epd_shift* shift,
+    unsigned int index,
+    unsigned int len,
+    unsigned int l,
+    unsigned char avoid
+) {
+    struct epd * epd = shift->epd;
+    unsigned char column = shift->column + index;
+    struct epd_edge* edge = NULL;
+    unsigned char bytes[EPD_EDGE_ROWS];
+    unsigned char buffer[EPD_WIDTH / 8];
+    unsigned char kept = l < EPD_EDGE_ROWS ? l : EPD_EDGE_ROWS;
+
+    for (unsigned int row = 0; row < kept; row++) {
+        epd_shift_row(shift, row, buffer, len);
+        bytes[row] = buffer[index];
+    }
+    epd_edge_drop(epd, shift->plane, column, column, shift->y, l);
+
+    for (unsigned char i = 0; i < EPD_EDGE_SLOTS && edge == NULL; i++) {
+        if (epd->edges[i].column == 0xff) {
+            edge = &epd->edges[i];
+        }
+    }
+    for (unsigned char i = 0; i < EPD_EDGE_SLOTS && edge == NULL; i++) {
+        struct epd_edge* victim = &epd->edges[epd->edge_next];
+
+        epd->edge_next = (epd->edge_next + 1) % EPD_EDGE_SLOTS;
+        if (victim->column != avoid || victim->plane != shift->plane) {
+            edge = victim;
+        }
+    }
+    if (edge == NULL) {
+        return;
+    }
+    memcpy(edge->bytes, bytes, kept);
+    edge->plane = shift->plane;
+    edge->column = column;
+    edge->y = shift->y;
+    edge->l = kept;
+}
+
+/**
+ *  @brief: stream one plane of a window at any x and width. Aligned ones
+ *          go straight out, the others through epd_shift_row over the
+ *          byte columns they touch.
+ */
+static void epd_set_plane(
+    struct epd * epd,
+    unsigned char plane,
+    const struct epd_source* source,
+    unsigned int x,
+    unsigned int y,
+    unsigned int w,
+    unsigned int l
+) {
+    unsigned char first = x / 8;
+    unsigned char last = (x + w - 1) / 8;
+    unsigned char end = (x + w) & 7;
+    struct epd_shift shift;
+    struct epd_source shifted;
+    unsigned int len = last - first + 1;
+
+    if (plane == 1 && epd_profile_bw(epd->profile)) {
+        return;
+    }
+    if ((x & 7) == 0 && end == 0) {
+        epd_send_plane(epd, plane, source, x, y, w, l);
+        epd_edge_drop(epd, plane, first, last, y, l);
+        if (source->kind == EPD_SOURCE_FILL && w == epd->width && l == epd->height) {
+            epd->background[plane] = source->fill;
+            memset(epd->written[plane], 0, sizeof(epd->written[plane]));
+        } else {
+            epd_edge_written(epd, plane, first, last, y, l);
+        }
+        return;
+    }
+    shift.epd = epd;
+    shift.source = source;
+    shift.plane = plane;
+    shift.column = first;
+    shift.shift = x & 7;
+    shift.left_mask = 0xFF >> shift.shift;
+    shift.right_mask = end != 0 ? 0xFF << (8 - end) : 0xFF;
+    shift.y = y;
+    shift.stride = (w + 7) / 8;
+    epd_source_rows(&shifted, epd_shift_row, &shift);
+    epd_send_plane(epd, plane, &shifted, first * 8, y, len * 8, l);
+
+    if (len > 2) {
+        epd_edge_drop(epd, plane, first + 1, last - 1, y, l);
+    }
+    if (shift.shift != 0) {
+        epd_edge_store(&shift, 0, len, l, end != 0 && len > 1 ? last : 0xff);
+    }
+    if (end != 0 && (len > 1 || shift.shift == 0)) {
+        epd_edge_store(&shift, len - 1, len, l, 0xff);
+    }
+    epd_edge_written(epd, plane, first, last, y, l);
+}
+
+/**
+ *  @brief: 1 when the pixels an unaligned window shares bytes with are
+ *          known, so epd_set_plane can keep them
+ */
+static int epd_plane_edges_known(
+    struct epd * epd,
+    unsigned char plane,
+    unsigned int x,
+    unsigned int y,
+    unsigned int w,
+    unsigned int l
+) {
+    if (plane == 1 && epd_profile_bw(epd->profile)) {
+        return 1;
+    }
+    if ((x & 7) != 0 && !epd_edge_known(epd, plane, x / 8, y, l)) {
+        return 0;
+    }
+    if (((x + w) & 7) != 0 && !epd_edge_known(epd, plane, (x + w - 1) / 8, y, l)) {
+        return 0;
+    }
+    return 1;
+}
+#else
+/**
+ *  @brief: stream one plane of a window, x and w in multiples of 8
+ */
+static void epd_set_plane(
+    struct epd * epd,
+    unsigned char plane,
+    const struct epd_source* source,
+    unsigned int x,
+    unsigned int y,
+    unsigned int w,
+    unsigned int l
+) {
+    if (plane == 1 && epd_profile_bw(epd->profile)) {
+        return;
+    }
+    epd_send_plane(epd, plane, source, x, y, w, l);
+}
+#endif
+
+void epd_source_ram(struct epd_source* source, const unsigned char* data) {
+    source->kind = EPD_SOURCE_RAM;
+    source->data = data;
+}
+
+void epd_source_P(struct epd_source* source, const unsigned char* data) {
+    source->kind = EPD_SOURCE_PGM;
+    source->data = data;
+}
+
+void epd_source_fill(struct epd_source* source, unsigned char fill) {
+    source->kind = EPD_SOURCE_FILL;
+    source->fill = fill;
+}
+
+/**
+ *  @brief: rows come from a callback, one at a time into a buffer on the
+ *          stack. It's called once to hash a row and once to send it, so
+ *          it has to give the same bytes both times.
+ */
+void epd_source_rows(struct epd_source* source, epd_row_generator rows, void* context) {
+    source->kind = EPD_SOURCE_ROWS;
+    source->rows = rows;
+    source->context = context;
+}
+
+/**
+ *  @brief: transmit a window of either plane or both to the SRAM. A NULL
+ *          source leaves that plane alone and a window covering the whole
+ *          panel goes out as a full frame. Every other upload function
+ *          ends up here.
+ *          x and w may be any number of pixels, the source then holds
+ *          (w + 7) / 8 bytes a row and is shifted into place. Pixels that
+ *          share a byte with the window are kept: an earlier unaligned
+ *          window left them in the edge shadow, or nothing has written
+ *          them since the last whole-plane fill (white after a clear).
+ *          Returns -1 without sending anything when the window is empty
+ *          or doesn't fit on the panel, or when those pixels aren't
+ *          known, e.g. after a whole image, a long unaligned window or
+ *          deep sleep. Widen the window to whole bytes then, with the
+ *          neighbouring pixels in the buffer. Built with
+ *          EPD_UNALIGNED_WINDOWS 0, x and w not in whole bytes return -1.
+ */
+int epd_set_window(
+    struct epd * epd,
+    const struct epd_source* black,
+    const struct epd_source* red,
+    unsigned int x,
+    unsigned int y,
+    unsigned int w,
+    unsigned int l
+) {
+    if (w == 0 || l == 0 || x >= epd->width || w > epd->width - x ||
+            y >= epd->height || l > epd->height - y) {
+        return -1;
+    }
+#if EPD_UNALIGNED_WINDOWS
+    if ((black != NULL && !epd_plane_edges_known(epd, 0, x, y, w, l)) ||
+            (red != NULL && !epd_plane_edges_known(epd, 1, x, y, w, l))) {
+        return -1;
+    }
+#else
+    if ((x & 7) != 0 || (w & 7) != 0) {
+        return -1;
+    }
+#endif
+    if (black != NULL) {
+        epd_set_plane(epd, 0, black, x, y, w, l);
+    }
+    if (red != NULL) {
+        epd_set_plane(epd, 1, red, x, y, w, l);
+    }
+    return 0;
+}
+
+/**
+ *  @brief: a RAM buffer, or 0x00 for NULL as the partial windows take it
+ */
+static const struct epd_source* epd_buffer_source(struct epd_source* source, const unsigned char* buffer) {
+    if (buffer != NULL) {
+        epd_source_ram(source, buffer);
+    } else {
+        epd_source_fill(source, 0x00);
+    }
+    return source;
+}
+
+/**
+ *  @brief: transmit partial data to the SRAM. Like the other window
+ *          functions it returns -1 for a window epd_set_window refuses.
+ */
+int epd_set_partial_window(
+    struct epd * epd,
+    const unsigned char* buffer_black,
+    const unsigned char* buffer_red,
+    int x,
+    int y,
+    int w,
+    int l
+) {
+    struct epd_source black;
+    struct epd_source red;
+
+    return epd_set_window(epd,
+        epd_buffer_source(&black, buffer_black),
+        epd_buffer_source(&red, buffer_red),
+        x, y, w, l);
+}
+
+
+/**
+ *  @brief: transmit partial data to the black part of SRAM
+ */
+int epd_set_partial_window_black(
+    struct epd * epd,
+    const unsigned char* buffer_black,
+    unsigned int x,
+    unsigned int y,
+    unsigned int w,
+    unsigned int l
+) {
+    struct epd_source black;
+
+    return epd_set_window(epd, epd_buffer_source(&black, buffer_black), NULL, x, y, w, l);
+}
+
+
+/**
+ *  @brief: transmit partial data to the red part of SRAM
+ */
+int epd_set_partial_window_red(
+    struct epd * epd,
+    const unsigned char* buffer_red,
+    unsigned int x,
+    unsigned int y,
+    unsigned int w,
+    unsigned int l
+) {
+    struct epd_source red;
+
+    return epd_set_window(epd, NULL, epd_buffer_source(&red, buffer_red), x, y, w, l);
+}
+
+/**
+ * @brief: upload both planes from PROGMEM, NULL skips a plane
+ */
+static void epd_send_frame_P(
+    struct epd * epd,
+    const unsigned char* frame_buffer_black,
+    const unsigned char* frame_buffer_red
+) {
+    struct epd_source black;
+    struct epd_source red;
+
+    epd_source_P(&black, frame_buffer_black);
+    epd_source_P(&red, frame_buffer_red);
+    epd_set_window(epd,
+        frame_buffer_black != NULL ? &black : NULL,
+        frame_buffer_red != NULL ? &red : NULL,
+        0, 0, epd->width, epd->height);
+}
+
+/**
+ * @brief: refresh and displays the frame
+ */
+void epd_display_frame_direct(
+    struct epd * epd,
+    const unsigned char* frame_buffer_black,
+    const unsigned char* frame_buffer_red
+) {
+    epd_send_frame_P(epd, frame_buffer_black, frame_buffer_red);
+    epd_display_frame(epd);
+}
+
+/**
+ * @brief: upload a whole frame from any source and refresh, NULL leaves
+ *         a plane as it is
+ */
+void epd_display_frame_source(
+    struct epd * epd,
+    const struct epd_source* black,
+    const struct epd_source* red
+) {
+    epd_set_window(epd, black, red, 0, 0, epd->width, epd->height);
+    epd_display_frame(epd);
+}
+
+
+/**
+ * @brief: clear the frame data from the SRAM, this won't refresh the display
+ */
+void epd_clear_frame_memory(struct epd * epd) {
+    struct epd_source white;
+
+    epd_source_fill(&white, 0xFF);
+    epd_set_window(epd, &white, &white, 0, 0, epd->width, epd->height);
+}
+
+/**
+ *  @brief: refresh on the next epd_display_frame even if nothing changed,
+ *          e.g. to clear ghosting. Also needed after frame data was sent
+ *          with the raw epd_send_* functions, which the band hashes miss.
+ */
+void epd_force_refresh(struct epd * epd) {
+    epd_forget_bands(epd);
+    epd->dirty = 1;
+    epd->red_dirty = 1;
+}
+
+
+/**
+ *  @brief: start collecting windows for a single refresh. Windows added
+ *          with epd_add_window* or epd_set_partial_window* go out as they
+ *          come, back to back in one partial mode session, and nothing
+ *          is refreshed until epd_commit. Idle timeouts wait for it too.
+ */
+void epd_begin(struct epd * epd) {
+    epd_wait_async(epd);
+    epd->transaction = 1;
+    epd->box_first = 0xff;
+    epd->box_last = 0;
+    if (epd->dirty) {
+        /* changes from before are refreshed along with the transaction */
+        epd_box_add(epd, 0, epd->width / 8 - 1, 0, epd->height - 1);
+    }
+}
+
+/**
+ *  @brief: add a window from RAM, NULL leaves that plane alone. Any source
+ *          can be added with epd_set_window.
+ */
+int epd_add_window(
+    struct epd * epd,
+    const unsigned char* buffer_black,
+    const unsigned char* buffer_red,
+    unsigned int x,
+    unsigned int y,
+    unsigned int w,
+    unsigned int l
+) {
+    struct epd_source black;
+    struct epd_source red;
+
+    epd_source_ram(&black, buffer_black);
+    epd_source_ram(&red, buffer_red);
+    return epd_set_window(epd,
+        buffer_black != NULL ? &black : NULL,
+        buffer_red != NULL ? &red : NULL,
+        x, y, w, l);
+}
+
+/**
+ *  @brief: add a window from PROGMEM, NULL leaves that plane alone
+ */
+int epd_add_window_P(
+    struct epd * epd,
+    const unsigned char* buffer_black,
+    const unsigned char* buffer_red,
+    unsigned int x,
+    unsigned int y,
+    unsigned int w,
+    unsigned int l
+) {
+    struct epd_source black;
+    struct epd_source red;
+
+    epd_source_P(&black, buffer_black);
+    epd_source_P(&red, buffer_red);
+    return epd_set_window(epd,
+        buffer_black != NULL ? &black : NULL,
+        buffer_red != NULL ? &red : NULL,
+        x, y, w, l);
+}
+
+/**
+ *  @brief: close the transaction. With EPD_GATE_SCAN_INSIDE the refresh
+ *          that follows stays in partial mode over the bounding box of
+ *          everything the transaction sent.
+ */
+static void epd_commit_end(struct epd * epd) {
+    epd->transaction = 0;
+    if (epd->gate_scan == EPD_GATE_SCAN_INSIDE && epd->dirty && epd->box_first <= epd->box_last) {
+        epd->box_refresh = 1;
+    } else {
+        epd_partial_out(epd);
+    }
+}
+
+/**
+ *  @brief: end the transaction with one refresh for all of its windows
+ */
+void epd_commit(struct epd * epd) {
+    epd_commit_end(epd);
+    epd_display_frame(epd);
+    epd_partial_out(epd);
+}
+
+/**
+ *  @brief: like epd_commit with the refresh of epd_display_frame_async
+ */
+void epd_commit_async(struct epd * epd, epd_callback done) {
+    epd_commit_end(epd);
+    epd_display_frame_async(epd, done);
+}
+
+/**
+ *  @brief: update the display
+ *          there are 2 memory areas embedded in the e-paper display
+ *          but once this function is called,
+ *          the the next action of SetFrameMemory or ClearFrame will
+ *          set the other memory area.
+ *          Does nothing when no upload has changed the SRAM since the
+ *          last refresh, see epd_force_refresh.
+ */
+void epd_display_frame(struct epd * epd) {
+    if (!epd->dirty) {
+        epd->busy_us = 0;
+        return;
+    }
+    epd_prepare_refresh(epd);
+    epd->dirty = 0;
+    epd->red_dirty = 0;
+    memset(epd->sent, 0, sizeof(epd->sent));
+    epd->state = EPD_STATE_REFRESHING;
+    epd_send_command(epd, DISPLAY_REFRESH);
+    epd_wait_until_idle(epd);
+    epd_set_state(epd, EPD_STATE_POWERED);
+}
+
+/**
+ *  @brief: refresh only a window, in partial mode with the gate scan set
+ *          by epd_set_gate_scan. x and w are widened to whole bytes. This
+ *          always refreshes and leaves the rest of the SRAM to the next
+ *          epd_display_frame.
+ */
+void epd_display_window(
+    struct epd * epd,
+    unsigned int x,
+    unsigned int y,
+    unsigned int w,
+    unsigned int l
+) {
+    epd_prepare_refresh(epd);
+    epd_set_partial_area(epd, x & ~7u, y, ((x + w + 7) & ~7u) - (x & ~7u), l);
+    epd->state = EPD_STATE_REFRESHING;
+    epd_send_command(epd, DISPLAY_REFRESH);
+    epd_wait_until_idle(epd);
+    epd_partial_out(epd);
+    epd_set_state(epd, EPD_STATE_POWERED);
+}
+
+/**
+ *  @brief: choose which gates scan in a partial refresh, for every window
+ *          sent from now on. Refreshes done in partial mode depend on it:
+ *          epd_display_window, and epd_commit when it is
+ *          EPD_GATE_SCAN_INSIDE, which then refreshes only the bounding
+ *          box of the transaction's windows. Set it before epd_begin to
+ *          cover a whole transaction.
+ */
+void epd_set_gate_scan(struct epd * epd, unsigned char gate_scan) {
+    epd->gate_scan = gate_scan;
+}
+
+/**
+ *  @brief: load the LUT registers from PROGMEM, EPD_LUTS_BYTES laid out
+ *          as VCOM_LUT, W2W_LUT, B2W_LUT, W2B_LUT and B2B_LUT. They are
+ *          only used with EPD_PANEL_REG_LUT set, see epd_set_profile.
+ */
+void epd_load_luts(struct epd * epd, const unsigned char* luts) {
+    epd_send_command(epd, VCOM_LUT);
+    epd_send_data_block_P(epd, luts, EPD_LUT_VCOM_BYTES);
+    luts += EPD_LUT_VCOM_BYTES;
+    for (unsigned char command = W2W_LUT; command <= B2B_LUT; command++) {
+        epd_send_command(epd, command);
+        epd_send_data_block_P(epd, luts, EPD_LUT_BYTES);
+        luts += EPD_LUT_BYTES;
+    }
+}
+
+/**
+ *  @brief: refresh with another waveform from now on, NULL goes back to
+ *          the OTP one. A black/white profile (EPD_PANEL_BW) takes the
+ *          black plane in DTM2 and drops red, so switching between that
+ *          and tri-colour forgets the SRAM and the next frame is sent in
+ *          full. Profiles stay in effect across deep sleep.
+ */
+void epd_set_profile(struct epd * epd, const struct epd_profile* profile) {
+    epd_wait_async(epd);
+    if (epd_profile_bw(profile) != epd_profile_bw(epd->profile)) {
+        epd_forget_sram(epd);
+        epd->dirty = 1;
+    }
+    epd->profile = profile;
+    if (epd->state >= EPD_STATE_STANDBY) {
+        epd_configure(epd);
+    }
+}
+
+/**
+ *  @brief: read the controller's internal temperature sensor, waking it
+ *          from deep sleep if need be. The reading is kept in
+ *          epd->temperature and returned, whole degrees C.
+ */
+signed char epd_read_temperature(struct epd * epd) {
+    epd_wake(epd);
+    epd_send_command(epd, TEMPERATURE_SENSOR_SELECTION);
+    epd_send_data(epd, EPD_TEMPERATURE_INTERNAL);
+    epd_send_command(epd, TEMPERATURE_SENSOR_CALIBRATION);
+    epd_wait_until_idle(epd);
+    /* D[10:3] first, two's complement in whole degrees, the fraction follows */
+    epd->temperature = (signed char)epd_if_spi_read();
+    epd->temperature_ms = epd_if_millis();
+    return epd->temperature;
+}
+
+/**
+ *  @brief: the band the reading falls in, the lowest one below them all
+ */
+static unsigned char epd_temperature_band(struct epd * epd) {
+    unsigned char band = 0;
+
+    for (unsigned char i = 1; i < epd->temperature_band_count; i++) {
+        if (epd->temperature >= epd->temperature_bands[i].min_celsius) {
+            band = i;
+        }
+    }
+    return band;
+}
+
+/**
+ *  @brief: before a refresh, read the sensor again once the reading is
+ *          older than the interval and switch to the band's profile
+ */
+static void epd_check_temperature(struct epd * epd) {
+    unsigned char band;
+
+    if (epd->temperature_bands == NULL) {
+        return;
+    }
+    if (epd->temperature == EPD_TEMPERATURE_UNKNOWN ||
+            epd_if_millis() - epd->temperature_ms >= epd->temperature_interval_ms) {
+        epd_read_temperature(epd);
+    }
+    band = epd_temperature_band(epd);
+    epd->temperature_band = band;
+    if (epd->profile != epd->temperature_bands[band].profile) {
+        epd_set_profile(epd, epd->temperature_bands[band].profile);
+    }
+}
+
+/**
+ *  @brief: pick the profile by temperature from now on. bands are sorted
+ *          by min_celsius and all either black/white or tri-colour, so a
+ *          change of band never changes what the SRAM holds. The sensor is
+ *          read before a refresh when the last reading is older than
+ *          interval_ms (0 reads before every refresh) and by epd_poll
+ *          while the panel is awake. NULL goes back to epd_set_profile.
+ */
+void epd_set_temperature_bands(
+    struct epd * epd,
+    const struct epd_temperature_band* bands,
+    unsigned char count,
+    unsigned long interval_ms
+) {
+    epd->temperature_bands = count != 0 ? bands : NULL;
+    epd->temperature_band_count = count;
+    epd->temperature_band = 0;
+    epd->temperature_interval_ms = interval_ms;
+    epd->temperature = EPD_TEMPERATURE_UNKNOWN;
+}
+
+/**
+ *  @brief: refresh with profile instead while no red bytes have gone out
+ *          since the last full refresh, so a black-only change skips the
+ *          slow red waveform. It must be tri-colour, the planes keep their
+ *          meaning, e.g. epd_profile_keep_red. NULL refreshes with the
+ *          current profile always. Not used with a black/white profile.
+ */
+void epd_set_bw_refresh(struct epd * epd, const struct epd_profile* profile) {
+    if (epd_profile_bw(profile)) {
+        return;
+    }
+    epd->bw_refresh = profile;
+}
+
+/**
+ *  @brief: power the panel for a refresh with the profile it calls for:
+ *          the temperature band's, or the black/white refresh when red
+ *          is clean
+ */
+static void epd_prepare_refresh(struct epd * epd) {
+    const struct epd_profile* profile;
+
+    epd_check_temperature(epd);
+    epd_power_on(epd);
+    profile = epd->profile;
+    if (epd->bw_refresh != NULL && !epd->red_dirty && !epd_profile_bw(profile)) {
+        profile = epd->bw_refresh;
+    }
+    if (epd->loaded != profile) {
+        epd_send_profile(epd, profile);
+    }
+    if (epd->box_refresh) {
+        epd->box_refresh = 0;
+        epd_set_partial_area(epd, epd->box_first * 8, epd->box_top,
+            (epd->box_last - epd->box_first + 1) * 8, epd->box_bottom - epd->box_top + 1);
+    } else {
+        epd_partial_out(epd);
+    }
+}
+
+/**
+ *  @brief: After this command is transmitted, the chip would enter the
+ *          deep-sleep mode to save power.
+ *          The deep sleep mode would return to standby by hardware reset.
+ *          Any later update wakes it again as needed.
+ */
+void epd_sleep(struct epd * epd) {
+    epd_power_off(epd);
+    if (epd->state == EPD_STATE_STANDBY) {
+        epd_run_sequence(epd, epd_deep_sleep_sequence);
+        epd_set_state(epd, EPD_STATE_DEEP_SLEEP);
+        epd_forget_sram(epd);
+    }
+}
+
+/**
+ *  @brief: BUSY went high on the panel in epd_async. Runs in interrupt
+ *          context, so it only records that; anything sent from here
+ *          could wait forever on a queued transfer.
+ */
+static void epd_async_idle(unsigned long busy_us) {
+    epd_async_busy_us = busy_us;
+    epd_async_finished = 1;
+}
+
+/**
+ *  @brief: finish the operation in epd_async after its BUSY edge, from
+ *          epd_poll, epd_is_busy or anything waiting for it. Configures
+ *          after a wake or enters a pending deep sleep, then hands over to
+ *          the caller's callback.
+ */
+static void epd_async_finish(struct epd * epd) {
+    epd_callback done = epd_async_done;
+
+    epd_async_finished = 0;
+    epd->busy_us = epd_async_busy_us;
+    if (epd_async_deep_sleep) {
+        epd_async_deep_sleep = 0;
+        epd_run_sequence(epd, epd_deep_sleep_sequence);
+        epd_set_state(epd, EPD_STATE_DEEP_SLEEP);
+        epd_forget_sram(epd);
+    } else {
+        if (epd_async_configure) {
+            epd_async_configure = 0;
+            epd_configure(epd);
+        }
+        epd_bring_up = EPD_BRING_UP_NONE;
+        epd_set_state(epd, EPD_STATE_POWERED);
+    }
+    epd_async = NULL;
+    if (done != NULL) {
+        done(epd);
+    }
+}
+
+static void epd_async_start(struct epd * epd, epd_callback done) {
+    epd_async_finished = 0;
+    epd_async = epd;
+    epd_async_done = done;
+    epd_if_on_idle(epd_async_idle);
+}
+
+/**
+ *  @brief: start bringing the panel up and return straight away, so the
+ *          frame can be rendered while the controller comes out of reset
+ *          and the booster charges. epd_poll releases the reset pulse on
+ *          time and, once BUSY says POWER_ON is done, configures the panel
+ *          and calls done (may be NULL). Any upload or refresh waits for it first.
+ */
+void epd_power_on_async(struct epd * epd, epd_callback done) {
+    epd_wait_async(epd);
+    if (epd->state >= EPD_STATE_POWERED) {
+        if (done != NULL) {
+            done(epd);
+        }
+        return;
+    }
+    epd_async_finished = 0;
+    epd_async = epd;
+    epd_async_done = done;
+    if (epd->state <= EPD_STATE_DEEP_SLEEP) {
+        epd_async_configure = 1;
+        epd_bring_up = EPD_BRING_UP_RESET;
+        epd_bring_up_ms = epd_if_millis();
+        epd->partial = 0;
+        epd_if_digital_write(RST_PIN, LOW);
+    } else {
+        epd_bring_up = EPD_BRING_UP_POWER_ON;
+        epd_if_on_idle(epd_async_idle);
+        epd_send_command(epd, POWER_ON);
+    }
+}
+
+/**
+ *  @brief: 1 while an asynchronous operation or the panel itself is busy.
+ *          Don't send anything to the panel until this returns 0. An
+ *          operation that has ended is finished here like in epd_poll.
+ */
+int epd_is_busy(struct epd * epd) {
+    if (epd_async == epd && epd_async_finished) {
+        epd_async_finish(epd);
+    }
+    return epd_async == epd || epd_if_digital_read(BUSY_PIN) == LOW;
+}
+
+/**
+ *  @brief: like epd_display_frame but returns as soon as the refresh has
+ *          started. done (may be NULL) is called by epd_poll or epd_is_busy
+ *          once it has finished, with the refresh time in epd->busy_us.
+ *          Without changes since the last refresh done runs right away.
+ */
+void epd_display_frame_async(struct epd * epd, epd_callback done) {
+    if (!epd->dirty) {
+        epd->busy_us = 0;
+        if (done != NULL) {
+            done(epd);
+        }
+        return;
+    }
+    epd_prepare_refresh(epd);
+    epd->dirty = 0;
+    epd->red_dirty = 0;
+    memset(epd->sent, 0, sizeof(epd->sent));
+    epd->state = EPD_STATE_REFRESHING;
+    epd_async_start(epd, done);
+    epd_send_command(epd, DISPLAY_REFRESH);
+}
+
+/**
+ *  @brief: like epd_display_frame_direct, the upload still blocks but the
+ *          refresh doesn't, see epd_display_frame_async
+ */
+void epd_display_frame_direct_async(
+    struct epd * epd,
+    const unsigned char* frame_buffer_black,
+    const unsigned char* frame_buffer_red,
+    epd_callback done
+) {
+    epd_send_frame_P(epd, frame_buffer_black, frame_buffer_red);
+    epd_display_frame_async(epd, done);
+}
+
+/**
+ *  @brief: like epd_sleep, DEEP_SLEEP is sent by epd_poll or epd_is_busy
+ *          once POWER_OFF has completed. When the panel isn't powered there is
+ *          nothing to wait for and done runs before this returns.
+ */
+void epd_sleep_async(struct epd * epd, epd_callback done) {
+    epd_wait_async(epd);
+    if (epd->state != EPD_STATE_POWERED) {
+        epd_sleep(epd);
+        if (done != NULL) {
+            done(epd);
+        }
+        return;
+    }
+    epd_async_deep_sleep = 1;
+    epd_async_start(epd, done);
+    epd_send_command(epd, POWER_OFF);
 }
 
 /* END OF FILE */
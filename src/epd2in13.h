@@ -72,21 +72,188 @@
 #define READ_OTP_DATA                               0xA2
 #define POWER_SAVING                                0xE3
 
+// Command sequences, byte code kept in PROGMEM and run by epd_run_sequence
+#define EPD_SEQ_END                                 0x00
+#define EPD_SEQ_RESET                               0x40    // hardware reset pulse
+#define EPD_SEQ_DELAY                               0x80    // next byte: ms
+#define EPD_SEQ_WAIT_BUSY                           0xC0
+#define EPD_SEQ_CMD(n)                              (0x20 | (n))    // command, then n (< 32) data bytes
+
+// Reset pulse, trimmed from the 200 ms + 200 ms of the reference code
+#define EPD_RESET_LOW_MS                            10
+#define EPD_RESET_SETTLE_MS                         10
+
+// Panel power states, in order of how awake the panel is
+#define EPD_STATE_OFF                               0   // never initialised
+#define EPD_STATE_DEEP_SLEEP                        1   // needs a reset to wake
+#define EPD_STATE_STANDBY                           2   // configured, power off
+#define EPD_STATE_POWERED                           3   // ready to refresh
+#define EPD_STATE_REFRESHING                        4
+
+// Row bands of each plane hashed to find what an upload actually changes
+#define EPD_BAND_ROWS                               8
+#define EPD_BANDS                                   ((EPD_HEIGHT + EPD_BAND_ROWS - 1) / EPD_BAND_ROWS)
+
+// Skip bands the panel already holds. 0 sends every window in full and
+// leaves the hashes out of struct epd (216 bytes), see EPD_BAND_HASHES in
+// the Makefile
+#ifndef EPD_BAND_HASHES
+#define EPD_BAND_HASHES                             1
+#endif
+
+// Plane sources, where the bytes of an upload come from
+#define EPD_SOURCE_RAM                              0
+#define EPD_SOURCE_PGM                              1
+#define EPD_SOURCE_FILL                             2   // the same byte throughout
+#define EPD_SOURCE_ROWS                             3   // generated a row at a time
+
+// PANEL_SETTING bits and the OTP waveform defaults
+#define EPD_PANEL_REG_LUT                           0x20    // waveform from the LUT registers
+#define EPD_PANEL_BW                                0x10    // black/white only, image in DTM2
+#define EPD_PANEL_SETTING_OTP                       0x8F
+#define EPD_VCOM_DATA_INTERVAL_OTP                  0x37
+
+// PLL_CONTROL frame rates, every waveform phase is counted in frames
+#define EPD_PLL_50HZ                                0x3C    // default
+#define EPD_PLL_100HZ                               0x3A
+#define EPD_PLL_150HZ                               0x29
+#define EPD_PLL_200HZ                               0x39
+
+// Register LUTs, VCOM_LUT then W2W, B2W, W2B and B2B back to back
+#define EPD_LUT_VCOM_BYTES                          44
+#define EPD_LUT_BYTES                               42
+#define EPD_LUTS_BYTES                              (EPD_LUT_VCOM_BYTES + 4 * EPD_LUT_BYTES)
+
+// Last PARTIAL_WINDOW byte, which gates a partial refresh scans
+#define EPD_GATE_SCAN_INSIDE                        0x00
+#define EPD_GATE_SCAN_ALL                           0x01    // inside and outside the window (default)
+
+// Shadow of the edge bytes of unaligned windows, neighbouring pixels come
+// from here or from the last whole-plane fill where nothing has been
+// written since, tracked in groups of EPD_EDGE_ROWS rows
+#define EPD_EDGE_SLOTS                              2
+#define EPD_EDGE_ROWS                               32
+
+// Windows at any x and width. 0 takes only whole bytes and leaves the edge
+// shadow out of struct epd (101 bytes), see EPD_UNALIGNED_WINDOWS in the
+// Makefile
+#ifndef EPD_UNALIGNED_WINDOWS
+#define EPD_UNALIGNED_WINDOWS                       1
+#endif
+
+// Internal temperature sensor, TEMPERATURE_SENSOR_SELECTION and readings
+#define EPD_TEMPERATURE_INTERNAL                    0x00
+#define EPD_TEMPERATURE_UNKNOWN                     (-128)  // no reading yet
+
+struct epd;
+
+/* fills len bytes of a row, counted from the first row of the window */
+typedef void (*epd_row_generator)(void* context, unsigned int row, unsigned char* buffer, unsigned int len);
+
+struct epd_source {
+    unsigned char kind;
+    unsigned char fill;
+    const unsigned char* data;
+    epd_row_generator rows;
+    void* context;
+};
+
+/* a waveform: how the panel is set up and the LUTs it refreshes with */
+struct epd_profile {
+    unsigned char panel_setting;
+    unsigned char vcom_data_interval;
+    unsigned char pll;          // EPD_PLL_*
+    const unsigned char* luts;  // PROGMEM, EPD_LUTS_BYTES, NULL for OTP
+};
+
+/* a profile for readings from min_celsius up to the next band's */
+struct epd_temperature_band {
+    signed char min_celsius;
+    const struct epd_profile* profile;
+};
+
+/* what the panel SRAM holds for one row band of a plane */
+struct epd_band {
+    unsigned int hash;          // CRC-16 of the band's bytes in [first, last]
+    unsigned char first;        // byte columns, first > last when unknown
+    unsigned char last;
+};
+
+/* completion callbacks run from epd_poll, epd_is_busy or a blocking call */
+typedef void (*epd_callback)(struct epd * epd);
+
+/* panel SRAM bytes of one byte column that an unaligned window shares */
+struct epd_edge {
+    unsigned char plane;
+    unsigned char column;       // 0xff when the slot is free
+    unsigned char y;
+    unsigned char l;            // rows kept, at most EPD_EDGE_ROWS
+    unsigned char bytes[EPD_EDGE_ROWS];
+};
+
 struct epd {
     unsigned int width;
     unsigned int height;
-    unsigned int reset_pin;
-    unsigned int dc_pin;
-    unsigned int cs_pin;
-    unsigned int busy_pin;
+    unsigned long busy_us;      // how long the last wait for BUSY took
+    volatile unsigned char state;
+    unsigned long last_active_ms;
+    unsigned long power_off_ms;     // idle timeouts, 0 disables
+    unsigned long deep_sleep_ms;
+#if EPD_BAND_HASHES
+    struct epd_band bands[2][EPD_BANDS];    // black, red
+#endif
+    unsigned char dirty;        // SRAM changed since the last refresh
+    unsigned char red_dirty;    // red bytes went out since the last full refresh
+    unsigned char sent[EPD_BANDS];  // bytes sent per band since the last refresh, saturating
+    unsigned char partial;      // controller is in partial mode
+    unsigned char transaction;  // between epd_begin and epd_commit
+    unsigned char gate_scan;    // EPD_GATE_SCAN_* for the windows to come
+    unsigned char box_first;    // byte columns and rows the transaction sent,
+    unsigned char box_last;     // first > last when none
+    unsigned char box_top;
+    unsigned char box_bottom;
+    unsigned char box_refresh;  // the next refresh is a partial one over the box
+    const struct epd_profile* profile;  // NULL for the OTP waveform
+    const struct epd_profile* bw_refresh;   // while red is clean, NULL for none
+    const struct epd_profile* loaded;   // what the controller is set up with
+#if EPD_UNALIGNED_WINDOWS
+    struct epd_edge edges[EPD_EDGE_SLOTS];
+    unsigned char edge_next;    // slot to reuse when all are taken
+    unsigned char background[2];    // byte of the last whole-plane fill
+    unsigned char written[2][EPD_WIDTH / 8];    // bit per row group of a byte column written since
+#endif
+    const struct epd_temperature_band* temperature_bands;   // NULL for none
+    unsigned char temperature_band_count;
+    unsigned char temperature_band; // index of the band in use
+    signed char temperature;        // last reading in C
+    unsigned long temperature_ms;   // when it was taken
+    unsigned long temperature_interval_ms;
 };
 
 int epd_init(struct epd * epd);
 void epd_send_command(struct epd * epd, unsigned char command);
 void epd_send_data(struct epd * epd, unsigned char data);
+void epd_send_data_block(struct epd * epd, const unsigned char* data, unsigned int len);
+void epd_send_data_block_P(struct epd * epd, const unsigned char* data, unsigned int len);
+void epd_send_data_fill(struct epd * epd, unsigned char data, unsigned int len);
 void epd_wait_until_idle(struct epd * epd);
 void epd_reset(struct epd * epd);
-void epd_set_partial_window(
+void epd_run_sequence(struct epd * epd, const unsigned char* sequence);
+void epd_source_ram(struct epd_source* source, const unsigned char* data);
+void epd_source_P(struct epd_source* source, const unsigned char* data);
+void epd_source_fill(struct epd_source* source, unsigned char fill);
+void epd_source_rows(struct epd_source* source, epd_row_generator rows, void* context);
+void epd_source_read_row(const struct epd_source* source, unsigned int row, unsigned char* buffer, unsigned int len);
+int epd_set_window(
+    struct epd * epd,
+    const struct epd_source* black,
+    const struct epd_source* red,
+    unsigned int x,
+    unsigned int y,
+    unsigned int w,
+    unsigned int l
+);
+int epd_set_partial_window(
     struct epd * epd,
     const unsigned char* buffer_black,
     const unsigned char* buffer_red,
@@ -95,7 +262,7 @@ void epd_set_partial_window(
     int w,
     int l
 );
-void epd_set_partial_window_black(
+int epd_set_partial_window_black(
     struct epd * epd,
     const unsigned char* buffer_black,
     unsigned int x,
@@ -103,7 +270,7 @@ void epd_set_partial_window_black(
     unsigned int w,
     unsigned int l
 );
-void epd_set_partial_window_red(
+int epd_set_partial_window_red(
     struct epd * epd,
     const unsigned char* buffer_red,
     unsigned int x,
@@ -116,9 +283,73 @@ void epd_display_frame_direct(
     const unsigned char* frame_buffer_black,
     const unsigned char* frame_buffer_red
 );
+void epd_display_frame_source(
+    struct epd * epd,
+    const struct epd_source* black,
+    const struct epd_source* red
+);
 void epd_clear_frame_memory(struct epd * epd);
 void epd_display_frame(struct epd * epd);
+void epd_display_window(
+    struct epd * epd,
+    unsigned int x,
+    unsigned int y,
+    unsigned int w,
+    unsigned int l
+);
+void epd_set_gate_scan(struct epd * epd, unsigned char gate_scan);
+void epd_load_luts(struct epd * epd, const unsigned char* luts);
+void epd_set_profile(struct epd * epd, const struct epd_profile* profile);
+void epd_force_refresh(struct epd * epd);
+void epd_set_bw_refresh(struct epd * epd, const struct epd_profile* profile);
+signed char epd_read_temperature(struct epd * epd);
+void epd_set_temperature_bands(
+    struct epd * epd,
+    const struct epd_temperature_band* bands,
+    unsigned char count,
+    unsigned long interval_ms
+);
+void epd_begin(struct epd * epd);
+int epd_add_window(
+    struct epd * epd,
+    const unsigned char* buffer_black,
+    const unsigned char* buffer_red,
+    unsigned int x,
+    unsigned int y,
+    unsigned int w,
+    unsigned int l
+);
+int epd_add_window_P(
+    struct epd * epd,
+    const unsigned char* buffer_black,
+    const unsigned char* buffer_red,
+    unsigned int x,
+    unsigned int y,
+    unsigned int w,
+    unsigned int l
+);
+void epd_commit(struct epd * epd);
+void epd_commit_async(struct epd * epd, epd_callback done);
 void epd_sleep(struct epd * epd);
+void epd_wake(struct epd * epd);
+void epd_power_on(struct epd * epd);
+void epd_power_off(struct epd * epd);
+void epd_set_idle_timeouts(
+    struct epd * epd,
+    unsigned long power_off_ms,
+    unsigned long deep_sleep_ms
+);
+void epd_poll(struct epd * epd);
+void epd_power_on_async(struct epd * epd, epd_callback done);
+int epd_is_busy(struct epd * epd);
+void epd_display_frame_async(struct epd * epd, epd_callback done);
+void epd_display_frame_direct_async(
+    struct epd * epd,
+    const unsigned char* frame_buffer_black,
+    const unsigned char* frame_buffer_red,
+    epd_callback done
+);
+void epd_sleep_async(struct epd * epd, epd_callback done);
 
 #endif /* EPD2IN13_H */
 
@@ -0,0 +1,108 @@
+/**
+ *  @filename   :   epdboard.h
+ *  @brief      :   Compile time pin map for the e-paper control lines
+ *
+ *  Select a layout with -DEPD_BOARD_<NAME> (see BOARD in the Makefile).
+ *  Every pin is a fixed port/bit pair so that each access compiles down to
+ *  a single sbi/cbi/sbis instruction.
+ *
+ *  EPD_BOARD_BCLOCK    CS = PB2, RST = PD7, DC = PD6, BUSY = PD5 (default)
+ *  EPD_BOARD_WAVESHARE Waveshare UNO shield: CS = D10 (PB2), DC = D9 (PB1),
+ *                      RST = D8 (PB0), BUSY = D7 (PD7)
+ *  EPD_BOARD_CUSTOM    all EPD_*_PORT/DDR/IN/BIT macros come from CFLAGS
+ *
+ *  BUSY also names its pin change interrupt (EPD_BUSY_PCMSK/_PCIE/_vect);
+ *  on the ATmega328 the bit in PCMSKn is the same as the port bit.
+ *
+ *  SCK and MOSI are only used by the bit-banged backend and default to the
+ *  hardware SPI pins (PB5, PB3) when a layout doesn't define them.
+ */
+
+#ifndef EPDBOARD_H
+#define EPDBOARD_H
+
+#include <avr/io.h>
+
+#if defined(EPD_BOARD_WAVESHARE)
+
+#define EPD_CS_PORT     PORTB
+#define EPD_CS_DDR      DDRB
+#define EPD_CS_IN       PINB
+#define EPD_CS_BIT      PB2
+
+#define EPD_RST_PORT    PORTB
+#define EPD_RST_DDR     DDRB
+#define EPD_RST_IN      PINB
+#define EPD_RST_BIT     PB0
+
+#define EPD_DC_PORT     PORTB
+#define EPD_DC_DDR      DDRB
+#define EPD_DC_IN       PINB
+#define EPD_DC_BIT      PB1
+
+#define EPD_BUSY_PORT   PORTD
+#define EPD_BUSY_DDR    DDRD
+#define EPD_BUSY_IN     PIND
+#define EPD_BUSY_BIT    PD7
+#define EPD_BUSY_PCMSK  PCMSK2
+#define EPD_BUSY_PCIE   PCIE2
+#define EPD_BUSY_vect   PCINT2_vect
+
+#elif defined(EPD_BOARD_CUSTOM)
+
+#if !defined(EPD_CS_PORT) || !defined(EPD_RST_PORT) || \
+    !defined(EPD_DC_PORT) || !defined(EPD_BUSY_PORT) || \
+    !defined(EPD_BUSY_vect)
+#error "EPD_BOARD_CUSTOM needs every EPD_*_PORT/DDR/IN/BIT macro defined"
+#endif
+
+#else /* EPD_BOARD_BCLOCK */
+
+#define EPD_CS_PORT     PORTB
+#define EPD_CS_DDR      DDRB
+#define EPD_CS_IN       PINB
+#define EPD_CS_BIT      PB2
+
+#define EPD_RST_PORT    PORTD
+#define EPD_RST_DDR     DDRD
+#define EPD_RST_IN      PIND
+#define EPD_RST_BIT     PD7
+
+#define EPD_DC_PORT     PORTD
+#define EPD_DC_DDR      DDRD
+#define EPD_DC_IN       PIND
+#define EPD_DC_BIT      PD6
+
+#define EPD_BUSY_PORT   PORTD
+#define EPD_BUSY_DDR    DDRD
+#define EPD_BUSY_IN     PIND
+#define EPD_BUSY_BIT    PD5
+#define EPD_BUSY_PCMSK  PCMSK2
+#define EPD_BUSY_PCIE   PCIE2
+#define EPD_BUSY_vect   PCINT2_vect
+
+#endif
+
+#ifndef EPD_SCK_PORT
+#define EPD_SCK_PORT    PORTB
+#define EPD_SCK_DDR     DDRB
+#define EPD_SCK_IN      PINB
+#define EPD_SCK_BIT     PB5
+#endif
+
+#ifndef EPD_MOSI_PORT
+#define EPD_MOSI_PORT   PORTB
+#define EPD_MOSI_DDR    DDRB
+#define EPD_MOSI_IN     PINB
+#define EPD_MOSI_BIT    PB3
+#endif
+
+#define EPD_PIN_SET(name)       (EPD_##name##_PORT |= (1<<EPD_##name##_BIT))
+#define EPD_PIN_CLEAR(name)     (EPD_##name##_PORT &= ~(1<<EPD_##name##_BIT))
+#define EPD_PIN_OUTPUT(name)    (EPD_##name##_DDR |= (1<<EPD_##name##_BIT))
+#define EPD_PIN_INPUT(name)     (EPD_##name##_DDR &= ~(1<<EPD_##name##_BIT))
+#define EPD_PIN_READ(name)      ((EPD_##name##_IN & (1<<EPD_##name##_BIT)) != 0)
+
+#endif
+
+/* END OF FILE */
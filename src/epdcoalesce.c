@@ -0,0 +1,121 @@
+/**
+ *  @filename   :   epdcoalesce.c
+ *  @brief      :   Coalesces bursts of changes into debounced refreshes
+ *
+ *  Changes are only marked as they happen. epd_coalesce_poll, called from
+ *  the main loop, flushes once nothing has changed for debounce_ms, or
+ *  max_wait_ms after the first change when the changes never stop. It
+ *  never waits on the panel: while a refresh runs, new changes are
+ *  collected for the next flush. A flush asks the upload callback for
+ *  every merged window in one transaction and starts the refresh with
+ *  epd_commit_async.
+ *
+ *  A change is visible at most max_wait_ms plus two refreshes after it
+ *  was marked: one refresh may still be running when the flush is due.
+ *  What each batch really took is reported, latency_ms from its last
+ *  change and wait_ms from its first, to the poll that saw it done.
+ */
+
+#include <stddef.h>
+#include "epdcoalesce.h"
+
+void epd_coalesce_init(
+    struct epd_coalescer * coalescer,
+    unsigned char planes,
+    unsigned long debounce_ms,
+    unsigned long max_wait_ms,
+    epd_coalesce_upload upload,
+    void* context
+) {
+    epd_regions_init(&coalescer->regions, planes, EPD_REGION_WINDOW_BYTES);
+    coalescer->debounce_ms = debounce_ms;
+    coalescer->max_wait_ms = max_wait_ms;
+    coalescer->upload = upload;
+    coalescer->context = context;
+    coalescer->refreshing = 0;
+    coalescer->pending_changes = 0;
+    coalescer->visible_changes = 0;
+    coalescer->changes = 0;
+    coalescer->batches = 0;
+    coalescer->latency_ms = 0;
+    coalescer->wait_ms = 0;
+    coalescer->worst_latency_ms = 0;
+    coalescer->worst_wait_ms = 0;
+}
+
+/**
+ *  @brief: a window has changed, x and w in pixels of any alignment
+ */
+void epd_coalesce_mark(
+    struct epd_coalescer * coalescer,
+    unsigned int x,
+    unsigned int y,
+    unsigned int w,
+    unsigned int l
+) {
+    unsigned long now = epd_if_millis();
+
+    if (coalescer->pending_changes == 0) {
+        coalescer->first_ms = now;
+    }
+    coalescer->last_ms = now;
+    coalescer->pending_changes++;
+    coalescer->changes++;
+    epd_regions_add(&coalescer->regions, x, y, w, l);
+}
+
+/**
+ *  @brief: the batch in flight has become visible
+ */
+static void epd_coalesce_visible(struct epd_coalescer * coalescer) {
+    unsigned long now = epd_if_millis();
+
+    coalescer->refreshing = 0;
+    coalescer->batches++;
+    coalescer->visible_changes = coalescer->batch_changes;
+    coalescer->latency_ms = now - coalescer->batch_last_ms;
+    coalescer->wait_ms = now - coalescer->batch_first_ms;
+    if (coalescer->latency_ms > coalescer->worst_latency_ms) {
+        coalescer->worst_latency_ms = coalescer->latency_ms;
+    }
+    if (coalescer->wait_ms > coalescer->worst_wait_ms) {
+        coalescer->worst_wait_ms = coalescer->wait_ms;
+    }
+}
+
+/**
+ *  @brief: call from the main loop along with epd_poll. Returns 1 when a
+ *          batch has just become visible, with its latency reported.
+ */
+int epd_coalesce_poll(struct epd_coalescer * coalescer, struct epd * epd) {
+    unsigned long now = epd_if_millis();
+    int visible = 0;
+
+    if (epd_is_busy(epd)) {
+        return 0;
+    }
+    if (coalescer->refreshing) {
+        epd_coalesce_visible(coalescer);
+        visible = 1;
+    }
+    if (coalescer->pending_changes == 0 ||
+            (now - coalescer->last_ms < coalescer->debounce_ms &&
+            now - coalescer->first_ms < coalescer->max_wait_ms)) {
+        return visible;
+    }
+
+    coalescer->refreshing = 1;
+    coalescer->batch_first_ms = coalescer->first_ms;
+    coalescer->batch_last_ms = coalescer->last_ms;
+    coalescer->batch_changes = coalescer->pending_changes;
+    coalescer->pending_changes = 0;
+    epd_begin(epd);
+    for (unsigned char i = 0; i < coalescer->regions.count; i++) {
+        coalescer->upload(epd, &coalescer->regions.rects[i], coalescer->context);
+    }
+    epd_regions_clear(&coalescer->regions);
+    epd_commit_async(epd, NULL);
+    return visible;
+}
+
+/* END OF FILE */
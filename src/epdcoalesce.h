@@ -0,0 +1,57 @@
+/**
+ *  @filename   :   epdcoalesce.h
+ *  @brief      :   Coalesces bursts of changes into debounced refreshes
+ */
+
+#ifndef EPDCOALESCE_H
+#define EPDCOALESCE_H
+
+#include "epd2in13.h"
+#include "epdregion.h"
+
+/* upload the current contents of a window, e.g. epd_set_partial_window */
+typedef void (*epd_coalesce_upload)(struct epd * epd, const struct epd_rect * rect, void* context);
+
+struct epd_coalescer {
+    struct epd_regions regions;     // changed since the last flush
+    unsigned long debounce_ms;      // quiet time before a flush
+    unsigned long max_wait_ms;      // flush anyway this long after the first change
+    epd_coalesce_upload upload;
+    void* context;
+    unsigned long first_ms;         // first and last change waiting
+    unsigned long last_ms;
+    unsigned char refreshing;       // a flushed batch is on its way
+    unsigned long batch_first_ms;   // first and last change of that batch
+    unsigned long batch_last_ms;
+    unsigned int batch_changes;
+    unsigned int pending_changes;
+    // report
+    unsigned int visible_changes;   // changes folded into the last batch
+    unsigned long changes;
+    unsigned long batches;
+    unsigned long latency_ms;       // last batch visible, from its last change to visible
+    unsigned long wait_ms;          // last batch visible, from its first change to visible
+    unsigned long worst_latency_ms;
+    unsigned long worst_wait_ms;
+};
+
+void epd_coalesce_init(
+    struct epd_coalescer * coalescer,
+    unsigned char planes,
+    unsigned long debounce_ms,
+    unsigned long max_wait_ms,
+    epd_coalesce_upload upload,
+    void* context
+);
+void epd_coalesce_mark(
+    struct epd_coalescer * coalescer,
+    unsigned int x,
+    unsigned int y,
+    unsigned int w,
+    unsigned int l
+);
+int epd_coalesce_poll(struct epd_coalescer * coalescer, struct epd * epd);
+
+#endif
+
+/* END OF FILE */
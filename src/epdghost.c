@@ -0,0 +1,139 @@
+/**
+ *  @filename   :   epdghost.c
+ *  @brief      :   Refresh scheduler mixing fast and clean refreshes
+ *
+ *  Fast waveforms leave a little of the old image behind every time. The
+ *  scheduler keeps the wear of each row band: how many fast refreshes
+ *  changed it and how many bytes went into it since the last clean
+ *  refresh. A refresh that would take any band past max_refreshes or
+ *  max_bytes is done with the clean profile instead and the wear starts
+ *  over. Past half the budget epd_ghosting_poll cleans on its own once
+ *  the panel has been idle for idle_ms, so the clean refresh rarely has
+ *  to hold up an update. Both profiles must be black/white or both
+ *  tri-colour, see epd_set_profile. Any refresh that ends up with the
+ *  clean profile counts as clean, so on a tri-colour panel fast can be
+ *  the clean profile too with epd_set_bw_refresh providing the fast
+ *  waveform whenever red hasn't changed.
+ */
+
+#include <string.h>
+#include "epdghost.h"
+
+void epd_ghosting_init(
+    struct epd_ghosting * ghosting,
+    const struct epd_profile* fast,
+    const struct epd_profile* clean,
+    unsigned char max_refreshes,
+    unsigned int max_bytes,
+    unsigned long idle_ms
+) {
+    ghosting->fast = fast;
+    ghosting->clean = clean;
+    ghosting->max_refreshes = max_refreshes;
+    ghosting->max_bytes = max_bytes;
+    ghosting->idle_ms = idle_ms;
+    memset(ghosting->refreshes, 0, sizeof(ghosting->refreshes));
+    memset(ghosting->bytes, 0, sizeof(ghosting->bytes));
+    ghosting->fast_refreshes = 0;
+    ghosting->clean_refreshes = 0;
+    ghosting->idle_cleans = 0;
+}
+
+static void epd_ghosting_use(struct epd * epd, const struct epd_profile* profile) {
+    if (epd->profile != profile) {
+        epd_set_profile(epd, profile);
+    }
+}
+
+/**
+ *  @brief: 1 when the pending refresh would take a band past the budget,
+ *          or with half set, when a band is at half the budget already
+ */
+static int epd_ghosting_worn(struct epd_ghosting * ghosting, struct epd * epd, int half) {
+    for (unsigned char i = 0; i < EPD_BANDS; i++) {
+        unsigned long refreshes = ghosting->refreshes[i];
+        unsigned long bytes = ghosting->bytes[i];
+
+        if (half) {
+            if (2 * refreshes >= ghosting->max_refreshes || 2 * bytes >= ghosting->max_bytes) {
+                return 1;
+            }
+        } else if (epd->sent[i] != 0) {
+            if (refreshes + 1 > ghosting->max_refreshes || bytes + epd->sent[i] > ghosting->max_bytes) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static void epd_ghosting_reset(struct epd_ghosting * ghosting) {
+    memset(ghosting->refreshes, 0, sizeof(ghosting->refreshes));
+    memset(ghosting->bytes, 0, sizeof(ghosting->bytes));
+    ghosting->clean_refreshes++;
+}
+
+/**
+ *  @brief: refresh the whole panel with the clean profile, changed or not,
+ *          and start the wear over
+ */
+void epd_ghosting_clean(struct epd_ghosting * ghosting, struct epd * epd) {
+    epd_ghosting_use(epd, ghosting->clean);
+    epd_force_refresh(epd);
+    epd_display_frame(epd);
+    epd_ghosting_use(epd, ghosting->fast);
+    epd_ghosting_reset(ghosting);
+}
+
+/**
+ *  @brief: epd_display_frame with the fast profile, or the clean one when
+ *          that would wear a band past the budget
+ */
+void epd_ghosting_refresh(struct epd_ghosting * ghosting, struct epd * epd) {
+    if (!epd->dirty) {
+        epd->busy_us = 0;
+        return;
+    }
+    if (epd_ghosting_worn(ghosting, epd, 0)) {
+        epd_ghosting_clean(ghosting, epd);
+        return;
+    }
+    epd_ghosting_use(epd, ghosting->fast);
+    for (unsigned char i = 0; i < EPD_BANDS; i++) {
+        if (epd->sent[i] != 0) {
+            unsigned int bytes = ghosting->bytes[i] + epd->sent[i];
+
+            if (ghosting->refreshes[i] != 0xff) {
+                ghosting->refreshes[i]++;
+            }
+            ghosting->bytes[i] = bytes < ghosting->bytes[i] ? 0xffff : bytes;
+        }
+    }
+    epd_display_frame(epd);
+    if (epd->loaded == ghosting->clean) {
+        epd_ghosting_reset(ghosting);
+    } else {
+        ghosting->fast_refreshes++;
+    }
+}
+
+/**
+ *  @brief: call from the main loop. Cleans when a band is at half its
+ *          budget, nothing is waiting to be refreshed and the panel has
+ *          been idle for idle_ms. The SRAM doesn't survive deep sleep, so
+ *          idle_ms should be shorter than the deep sleep timeout. Returns
+ *          1 when it cleaned.
+ */
+int epd_ghosting_poll(struct epd_ghosting * ghosting, struct epd * epd) {
+    if (ghosting->idle_ms == 0 || epd->dirty || epd_is_busy(epd) ||
+            epd->state < EPD_STATE_STANDBY || epd->transaction ||
+            epd_if_millis() - epd->last_active_ms < ghosting->idle_ms ||
+            !epd_ghosting_worn(ghosting, epd, 1)) {
+        return 0;
+    }
+    epd_ghosting_clean(ghosting, epd);
+    ghosting->idle_cleans++;
+    return 1;
+}
+
+/* END OF FILE */
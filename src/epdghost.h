@@ -0,0 +1,40 @@
+/**
+ *  @filename   :   epdghost.h
+ *  @brief      :   Refresh scheduler mixing fast and clean refreshes
+ */
+
+#ifndef EPDGHOST_H
+#define EPDGHOST_H
+
+#include "epd2in13.h"
+
+struct epd_ghosting {
+    const struct epd_profile* fast;     // the everyday waveform
+    const struct epd_profile* clean;    // the one that clears ghosting
+    unsigned char max_refreshes;    // fast refreshes a band takes before a clean one
+    unsigned int max_bytes;         // bytes a band takes before a clean one
+    unsigned long idle_ms;          // idle time before cleaning early, 0 never
+    // wear of each row band since the last clean refresh
+    unsigned char refreshes[EPD_BANDS];
+    unsigned int bytes[EPD_BANDS];
+    // totals
+    unsigned long fast_refreshes;
+    unsigned long clean_refreshes;
+    unsigned long idle_cleans;      // clean refreshes done by epd_ghosting_poll
+};
+
+void epd_ghosting_init(
+    struct epd_ghosting * ghosting,
+    const struct epd_profile* fast,
+    const struct epd_profile* clean,
+    unsigned char max_refreshes,
+    unsigned int max_bytes,
+    unsigned long idle_ms
+);
+void epd_ghosting_refresh(struct epd_ghosting * ghosting, struct epd * epd);
+void epd_ghosting_clean(struct epd_ghosting * ghosting, struct epd * epd);
+int epd_ghosting_poll(struct epd_ghosting * ghosting, struct epd * epd);
+
+#endif
+
+/* END OF FILE */
@@ -25,73 +25,101 @@
  * THE SOFTWARE.
  */
 
+#include <stddef.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
 #include <util/delay.h>
 
+#include "clock.h"
 #include "epdif.h"
 
-// CS = PB2
-// RESET = PD7
-// DC = PD6
-// BUSY = PD5
+/**
+ *  Sleep mode while waiting for BUSY. In power-down Timer1 stops as well,
+ *  so the recorded busy time is only meaningful in idle.
+ */
+#ifndef EPD_IF_BUSY_SLEEP
+#define EPD_IF_BUSY_SLEEP   SLEEP_MODE_IDLE
+#endif
 
-void epd_if_digital_write(int pin, int value) {
-    if (pin == RST_PIN) {
-        if (value == LOW) {
-            PORTD &= ~(1<<PD7);
-        } else {
-            PORTD |= (1<<PD7);
-        }
-    }
-    if (pin == DC_PIN) {
-        if (value == LOW) {
-            PORTD &= ~(1<<PD6);
-        } else {
-            PORTD |= (1<<PD6);
-        }
-    }
-    if (pin == CS_PIN) {
-        if (value == LOW) {
-            PORTB &= ~(1<<PB2);
-        } else {
-            PORTB |= (1<<PB2);
-        }
-    }
-    if (pin == BUSY_PIN) {
-        if (value == LOW) {
-            PORTD &= ~(1<<PD5);
-        } else {
-            PORTD |= (1<<PD5);
-        }
+static volatile epd_if_idle_callback epd_if_idle;
+static volatile unsigned long epd_if_idle_armed_us;
+
+/**
+ *  @brief: wakes epd_if_wait_until_idle, which rechecks the pin itself,
+ *          and completes an armed epd_if_on_idle on the rising edge
+ */
+ISR(EPD_BUSY_vect) {
+    epd_if_idle_callback callback = epd_if_idle;
+
+    if (callback != NULL && EPD_PIN_READ(BUSY)) {
+        epd_if_idle = NULL;
+        PCICR &= ~(1<<EPD_BUSY_PCIE);
+        callback(clock_us() - epd_if_idle_armed_us);
     }
 }
 
-int epd_if_digital_read(int pin) {
-    if (pin == RST_PIN) {
-        return (PIND & (1<<PD7)) >> PD7;
-    }
-    if (pin == DC_PIN) {
-        return (PIND & (1<<PD6)) >> PD6;
+int epd_if_init(void) {
+    EPD_PIN_OUTPUT(CS);
+    EPD_PIN_OUTPUT(RST);
+    EPD_PIN_OUTPUT(DC);
+    EPD_PIN_INPUT(BUSY);
+    EPD_PIN_SET(CS);
+    EPD_BUSY_PCMSK |= (1<<EPD_BUSY_BIT);
+    clock_init();
+    epd_if_bus_init();
+    return 0;
+}
+
+void epd_if_delay_ms(unsigned int delaytime) {
+    while (delaytime--) {
+        _delay_ms(1);
     }
-    if (pin == CS_PIN) {
-        return (PINB & (1<<PB2)) >> PB2;
+}
+
+unsigned long epd_if_millis(void) {
+    return clock_ms();
+}
+
+unsigned long epd_if_micros(void) {
+    return clock_us();
+}
+
+/**
+ *  @brief: sleep until BUSY goes high (LOW: busy, HIGH: idle). The BUSY pin
+ *          change interrupt wakes the CPU within microseconds of the edge.
+ *          sei takes effect after the next instruction, so an edge between
+ *          the check and sleep_cpu still wakes us.
+ */
+unsigned long epd_if_wait_until_idle(void) {
+    unsigned long start = clock_us();
+
+    set_sleep_mode(EPD_IF_BUSY_SLEEP);
+    PCICR |= (1<<EPD_BUSY_PCIE);
+    while (1) {
+        cli();
+        if (EPD_PIN_READ(BUSY)) {
+            break;
+        }
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        sleep_disable();
     }
-    if (pin == BUSY_PIN) {
-        return (PIND & (1<<PD5)) >> PD5;
+    if (epd_if_idle == NULL) {
+        PCICR &= ~(1<<EPD_BUSY_PCIE);
     }
-    return -1;
+    sei();
+    return clock_us() - start;
 }
 
-void epd_if_spi_transfer(unsigned char data) {
-    epd_if_digital_write(CS_PIN, LOW);
-    SPDR = data;
-    while (!(SPSR & (1<<SPIF)));
-    epd_if_digital_write(CS_PIN, HIGH);
-}
+void epd_if_on_idle(epd_if_idle_callback callback) {
+    unsigned char sreg = SREG;
 
-int epd_if_init(void) {
-    DDRB = (1<<PB3) | (1<<PB5) | (1<<PB2);
-    DDRD = (1<<PD7) | (1<<PD6) | (0<<PD5);
-    SPCR = (1<<SPE) | (1<<MSTR) | (1<<SPR0);
-    PORTB |= (1<<PB2);
-    return 0;
+    cli();
+    epd_if_idle_armed_us = clock_us();
+    epd_if_idle = callback;
+    /* forget edges from before arming, PCIFn sits at the same bit as PCIEn */
+    PCIFR = (1<<EPD_BUSY_PCIE);
+    PCICR |= (1<<EPD_BUSY_PCIE);
+    SREG = sreg;
 }
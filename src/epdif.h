@@ -28,7 +28,9 @@
 #ifndef EPDIF_H
 #define EPDIF_H
 
-#include <avr/io.h>
+#ifdef __AVR__
+#include "epdboard.h"
+#endif
 
 // Pin definition
 #define RST_PIN         0
@@ -39,10 +41,136 @@
 #define LOW 0
 #define HIGH 1
 
-int epd_if_init(void);
+/**
+ *  Transport contract. epd2in13.c only talks to the panel through the
+ *  functions below: pins, single bytes, DC-qualified bursts from RAM,
+ *  PROGMEM or a constant, the transmit queue, delays and waiting for BUSY
+ *  (epd_if_wait_until_idle returns how long BUSY was low in us), a
+ *  millisecond time base for timeouts (epd_if_millis) and a microsecond
+ *  one for timing transfers (epd_if_micros, wraps after ~71 minutes).
+ *  Exactly one backend implementing them is linked in, see EPD_IF in the
+ *  Makefile:
+ *
+ *  epdif_spi.c         hardware SPI
+ *  epdif_usart.c       USART0 in master SPI mode
+ *  epdif_bitbang.c     bit-banged SPI on any pins from epdboard.h
+ *  host/epdif_sim.c    host simulator writing each refresh to a PPM file
+ *  host/epdif_trace.c  host backend printing every bus transaction
+ *
+ *  Selection happens at link time so the hardware build pays no indirect
+ *  calls, and every burst runs as one tight loop inside the backend.
+ */
+
+#ifdef __AVR__
+/**
+ *  @brief: pin access. pin is always one of the constants above so these
+ *          fold down to a single sbi/cbi/sbis, see epdboard.h.
+ */
+static inline __attribute__((always_inline))
+void epd_if_digital_write(int pin, int value) {
+    switch (pin) {
+    case RST_PIN:
+        if (value == LOW) EPD_PIN_CLEAR(RST); else EPD_PIN_SET(RST);
+        break;
+    case DC_PIN:
+        if (value == LOW) EPD_PIN_CLEAR(DC); else EPD_PIN_SET(DC);
+        break;
+    case CS_PIN:
+        if (value == LOW) EPD_PIN_CLEAR(CS); else EPD_PIN_SET(CS);
+        break;
+    case BUSY_PIN:
+        if (value == LOW) EPD_PIN_CLEAR(BUSY); else EPD_PIN_SET(BUSY);
+        break;
+    }
+}
+
+static inline __attribute__((always_inline))
+int epd_if_digital_read(int pin) {
+    switch (pin) {
+    case RST_PIN:
+        return EPD_PIN_READ(RST);
+    case DC_PIN:
+        return EPD_PIN_READ(DC);
+    case CS_PIN:
+        return EPD_PIN_READ(CS);
+    case BUSY_PIN:
+        return EPD_PIN_READ(BUSY);
+    }
+    return -1;
+}
+#else
 void epd_if_digital_write(int pin, int value);
 int epd_if_digital_read(int pin);
+#endif
+
+int epd_if_init(void);
+
+/**
+ *  @brief: name of the linked backend. epd_if_bus_init re-claims the bus,
+ *          e.g. after the USART served as UART.
+ */
+extern const char epd_if_backend[];
+void epd_if_bus_init(void);
+
 void epd_if_delay_ms(unsigned int delaytime);
+unsigned long epd_if_millis(void);
+unsigned long epd_if_micros(void);
+unsigned long epd_if_wait_until_idle(void);
+
+/**
+ *  @brief: arm a one-shot callback for the next BUSY low to high edge, for
+ *          operations that run while the caller gets on with other work.
+ *          Arm before issuing the command. The callback runs in interrupt
+ *          context and gets the time since arming in us.
+ */
+typedef void (*epd_if_idle_callback)(unsigned long busy_us);
+
+void epd_if_on_idle(epd_if_idle_callback callback);
 void epd_if_spi_transfer(unsigned char data);
+void epd_if_spi_transfer_block(int dc, const unsigned char* data, unsigned int len);
+void epd_if_spi_transfer_block_P(int dc, const unsigned char* data, unsigned int len);
+void epd_if_spi_transfer_fill(int dc, unsigned char data, unsigned int len);
+
+/**
+ *  @brief: read a data byte back after a command that answers, e.g. the
+ *          temperature sensor. The panel's bus is 3-wire, so the backend
+ *          lets go of DIN and clocks the controller's byte in on it.
+ */
+unsigned char epd_if_spi_read(void);
+
+#ifndef __AVR__
+/* host backends only: what the temperature sensor reads from now on */
+void epd_if_host_set_temperature(signed char celsius);
+#endif
+
+/**
+ *  Interrupt driven transmit queue. Each queued segment sets DC once and
+ *  holds CS for its whole run, exactly like the blocking block transfers,
+ *  but the bytes are fed from SPI_STC_vect so the caller can keep working.
+ *  The data must stay valid until the segment has been sent. The queue
+ *  functions return -1 when all EPD_IF_QUEUE_SIZE slots are in use.
+ *  The callback runs in interrupt context once the queue has drained.
+ *  The blocking calls wait for the queue to drain before touching the bus.
+ *  Backends without a transmit interrupt (usart, bitbang, host) transmit
+ *  at once from the queue calls and run the callback before returning.
+ */
+#define EPD_IF_QUEUE_SIZE   8
+
+typedef void (*epd_if_callback)(void);
+
+extern volatile unsigned char epd_if_spi_active;
+
+int epd_if_spi_queue_block(int dc, const unsigned char* data, unsigned int len);
+int epd_if_spi_queue_block_P(int dc, const unsigned char* data, unsigned int len);
+int epd_if_spi_queue_fill(int dc, unsigned char data, unsigned int len);
+void epd_if_spi_set_callback(epd_if_callback callback);
+
+static inline int epd_if_spi_busy(void) {
+    return epd_if_spi_active;
+}
+
+static inline void epd_if_spi_wait(void) {
+    while (epd_if_spi_active);
+}
 
 #endif
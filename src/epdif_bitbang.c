@@ -0,0 +1,147 @@
+/**
+ *  @filename   :   epdif_bitbang.c
+ *  @brief      :   EPD interface bus backend bit-banging SPI mode 0
+ *
+ *  For boards where the hardware SPI pins are taken. SCK and MOSI can be
+ *  any pins, see EPD_SCK_* and EPD_MOSI_* in epdboard.h. Every byte is a
+ *  fully unrolled sequence on the compile time port/bit constants:
+ *
+ *  same port   bst/bld the data bit into a copy of the port, out, sbi SCK:
+ *              5 cycles a bit, 1.6 Mbit/s at 8 MHz. The copy is only valid
+ *              with interrupts off, so each byte runs inside cli/SREG.
+ *  split ports sbrc/sbi/sbrs/cbi on MOSI then toggle SCK twice through its
+ *              PIN register: 7 cycles a bit, 1.1 Mbit/s at 8 MHz.
+ *
+ *  The block transfers are the burst mode, DC and CS stay put for the run.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "epdif.h"
+
+const char epd_if_backend[] = "bitbang";
+
+#define EPD_BITBANG_SAME_PORT   (&EPD_SCK_PORT == &EPD_MOSI_PORT)
+
+#define EPD_BITBANG_SAME_BIT(n)             \
+    "bst %[data], " #n              "\n\t"  \
+    "bld %[port_value], %[mosi]"    "\n\t"  \
+    "out %[port], %[port_value]"    "\n\t"  \
+    "sbi %[port], %[sck]"           "\n\t"
+
+#define EPD_BITBANG_SPLIT_BIT(n)            \
+    "sbrc %[data], " #n             "\n\t"  \
+    "sbi %[mosi_port], %[mosi]"     "\n\t"  \
+    "sbrs %[data], " #n             "\n\t"  \
+    "cbi %[mosi_port], %[mosi]"     "\n\t"  \
+    "out %[sck_in], %[sck_mask]"    "\n\t"  \
+    "out %[sck_in], %[sck_mask]"    "\n\t"
+
+static inline __attribute__((always_inline))
+void epd_if_bitbang_byte(unsigned char data) {
+    if (EPD_BITBANG_SAME_PORT) {
+        unsigned char sreg = SREG;
+        unsigned char port_value;
+
+        cli();
+        /* SCK is low between bytes, so the copy also drops SCK on each out */
+        port_value = EPD_SCK_PORT;
+        __asm__ __volatile__(
+            EPD_BITBANG_SAME_BIT(7)
+            EPD_BITBANG_SAME_BIT(6)
+            EPD_BITBANG_SAME_BIT(5)
+            EPD_BITBANG_SAME_BIT(4)
+            EPD_BITBANG_SAME_BIT(3)
+            EPD_BITBANG_SAME_BIT(2)
+            EPD_BITBANG_SAME_BIT(1)
+            EPD_BITBANG_SAME_BIT(0)
+            "cbi %[port], %[sck]"
+            : [port_value] "+r" (port_value)
+            : [data] "r" (data),
+              [port] "I" (_SFR_IO_ADDR(EPD_SCK_PORT)),
+              [sck] "I" (EPD_SCK_BIT),
+              [mosi] "I" (EPD_MOSI_BIT)
+        );
+        SREG = sreg;
+    } else {
+        __asm__ __volatile__(
+            EPD_BITBANG_SPLIT_BIT(7)
+            EPD_BITBANG_SPLIT_BIT(6)
+            EPD_BITBANG_SPLIT_BIT(5)
+            EPD_BITBANG_SPLIT_BIT(4)
+            EPD_BITBANG_SPLIT_BIT(3)
+            EPD_BITBANG_SPLIT_BIT(2)
+            EPD_BITBANG_SPLIT_BIT(1)
+            EPD_BITBANG_SPLIT_BIT(0)
+            :
+            : [data] "r" (data),
+              [sck_mask] "r" ((unsigned char)(1<<EPD_SCK_BIT)),
+              [sck_in] "I" (_SFR_IO_ADDR(EPD_SCK_IN)),
+              [mosi_port] "I" (_SFR_IO_ADDR(EPD_MOSI_PORT)),
+              [mosi] "I" (EPD_MOSI_BIT)
+        );
+    }
+}
+
+void epd_if_spi_transfer(unsigned char data) {
+    epd_if_digital_write(CS_PIN, LOW);
+    epd_if_bitbang_byte(data);
+    epd_if_digital_write(CS_PIN, HIGH);
+}
+
+void epd_if_spi_transfer_block(int dc, const unsigned char* data, unsigned int len) {
+    epd_if_digital_write(DC_PIN, dc);
+    epd_if_digital_write(CS_PIN, LOW);
+    while (len--) {
+        epd_if_bitbang_byte(*data++);
+    }
+    epd_if_digital_write(CS_PIN, HIGH);
+}
+
+void epd_if_spi_transfer_block_P(int dc, const unsigned char* data, unsigned int len) {
+    epd_if_digital_write(DC_PIN, dc);
+    epd_if_digital_write(CS_PIN, LOW);
+    while (len--) {
+        epd_if_bitbang_byte(pgm_read_byte(data++));
+    }
+    epd_if_digital_write(CS_PIN, HIGH);
+}
+
+void epd_if_spi_transfer_fill(int dc, unsigned char data, unsigned int len) {
+    epd_if_digital_write(DC_PIN, dc);
+    epd_if_digital_write(CS_PIN, LOW);
+    while (len--) {
+        epd_if_bitbang_byte(data);
+    }
+    epd_if_digital_write(CS_PIN, HIGH);
+}
+
+/**
+ *  @brief: MOSI turns into an input for the byte, sampled after each
+ *          rising SCK edge
+ */
+unsigned char epd_if_spi_read(void) {
+    unsigned char data = 0;
+
+    EPD_PIN_INPUT(MOSI);
+    epd_if_digital_write(DC_PIN, HIGH);
+    epd_if_digital_write(CS_PIN, LOW);
+    for (unsigned char bit = 0; bit < 8; bit++) {
+        EPD_PIN_SET(SCK);
+        data = (data << 1) | EPD_PIN_READ(MOSI);
+        EPD_PIN_CLEAR(SCK);
+    }
+    epd_if_digital_write(CS_PIN, HIGH);
+    EPD_PIN_OUTPUT(MOSI);
+    return data;
+}
+
+void epd_if_bus_init(void) {
+    EPD_PIN_CLEAR(SCK);
+    EPD_PIN_OUTPUT(SCK);
+    EPD_PIN_OUTPUT(MOSI);
+}
+
+/* END OF FILE */
@@ -0,0 +1,230 @@
+/**
+ *  @filename   :   epdif_spi.c
+ *  @brief      :   EPD interface bus backend on the hardware SPI (SPDR)
+ *  @author     :   Yehui from Waveshare
+ *
+ *  Copyright (C) Waveshare     August 10 2017
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documnetation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to  whom the Software is
+ * furished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS OR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "epdif.h"
+
+const char epd_if_backend[] = "spi";
+
+#define EPD_IF_SEGMENT_RAM      0
+#define EPD_IF_SEGMENT_PGM      1
+#define EPD_IF_SEGMENT_FILL     2
+
+struct epd_if_segment {
+    const unsigned char* data;
+    unsigned int len;
+    unsigned char type;
+    unsigned char fill;
+    unsigned char dc;
+};
+
+static struct epd_if_segment epd_if_queue[EPD_IF_QUEUE_SIZE];
+static volatile unsigned char epd_if_queue_head;
+static volatile unsigned char epd_if_queue_tail;
+static epd_if_callback epd_if_spi_callback;
+volatile unsigned char epd_if_spi_active;
+
+void epd_if_spi_transfer(unsigned char data) {
+    epd_if_spi_wait();
+    epd_if_digital_write(CS_PIN, LOW);
+    SPDR = data;
+    while (!(SPSR & (1<<SPIF)));
+    epd_if_digital_write(CS_PIN, HIGH);
+}
+
+/**
+ *  @brief: block transfers. DC is set once and CS is held low for the whole
+ *          run, so the per byte cost is only loading SPDR and waiting for
+ *          SPIF.
+ */
+void epd_if_spi_transfer_block(int dc, const unsigned char* data, unsigned int len) {
+    epd_if_spi_wait();
+    epd_if_digital_write(DC_PIN, dc);
+    epd_if_digital_write(CS_PIN, LOW);
+    while (len--) {
+        SPDR = *data++;
+        while (!(SPSR & (1<<SPIF)));
+    }
+    epd_if_digital_write(CS_PIN, HIGH);
+}
+
+void epd_if_spi_transfer_block_P(int dc, const unsigned char* data, unsigned int len) {
+    epd_if_spi_wait();
+    epd_if_digital_write(DC_PIN, dc);
+    epd_if_digital_write(CS_PIN, LOW);
+    while (len--) {
+        SPDR = pgm_read_byte(data++);
+        while (!(SPSR & (1<<SPIF)));
+    }
+    epd_if_digital_write(CS_PIN, HIGH);
+}
+
+void epd_if_spi_transfer_fill(int dc, unsigned char data, unsigned int len) {
+    epd_if_spi_wait();
+    epd_if_digital_write(DC_PIN, dc);
+    epd_if_digital_write(CS_PIN, LOW);
+    while (len--) {
+        SPDR = data;
+        while (!(SPSR & (1<<SPIF)));
+    }
+    epd_if_digital_write(CS_PIN, HIGH);
+}
+
+static inline unsigned char epd_if_segment_next(struct epd_if_segment * segment) {
+    unsigned char data;
+
+    if (segment->type == EPD_IF_SEGMENT_PGM) {
+        data = pgm_read_byte(segment->data++);
+    } else if (segment->type == EPD_IF_SEGMENT_RAM) {
+        data = *segment->data++;
+    } else {
+        data = segment->fill;
+    }
+    segment->len--;
+    return data;
+}
+
+static void epd_if_segment_start(struct epd_if_segment * segment) {
+    epd_if_digital_write(DC_PIN, segment->dc);
+    epd_if_digital_write(CS_PIN, LOW);
+    SPDR = epd_if_segment_next(segment);
+}
+
+/**
+ *  @brief: feeds the next byte of the head segment. While the queue runs
+ *          the bus drops to fosc/16: at fosc/2 a byte takes 16 cycles which
+ *          is less than the interrupt entry and exit, leaving no CPU time.
+ */
+ISR(SPI_STC_vect) {
+    struct epd_if_segment * segment = &epd_if_queue[epd_if_queue_head];
+
+    if (segment->len != 0) {
+        SPDR = epd_if_segment_next(segment);
+        return;
+    }
+    epd_if_digital_write(CS_PIN, HIGH);
+    epd_if_queue_head = (epd_if_queue_head + 1) % EPD_IF_QUEUE_SIZE;
+    if (epd_if_queue_head != epd_if_queue_tail) {
+        epd_if_segment_start(&epd_if_queue[epd_if_queue_head]);
+        return;
+    }
+    SPCR &= ~((1<<SPIE) | (1<<SPR0));
+    SPSR = (1<<SPI2X);
+    epd_if_spi_active = 0;
+    if (epd_if_spi_callback != NULL) {
+        epd_if_spi_callback();
+    }
+}
+
+static int epd_if_spi_queue(
+    unsigned char type,
+    int dc,
+    const unsigned char* data,
+    unsigned char fill,
+    unsigned int len
+) {
+    unsigned char sreg = SREG;
+    unsigned char next;
+    struct epd_if_segment * segment;
+
+    if (len == 0) {
+        return 0;
+    }
+    cli();
+    next = (epd_if_queue_tail + 1) % EPD_IF_QUEUE_SIZE;
+    if (next == epd_if_queue_head) {
+        SREG = sreg;
+        return -1;
+    }
+    segment = &epd_if_queue[epd_if_queue_tail];
+    segment->data = data;
+    segment->len = len;
+    segment->type = type;
+    segment->fill = fill;
+    segment->dc = dc;
+    epd_if_queue_tail = next;
+    if (!epd_if_spi_active) {
+        epd_if_spi_active = 1;
+        SPSR = 0;
+        SPCR |= (1<<SPR0);
+        epd_if_segment_start(segment);
+        SPCR |= (1<<SPIE);
+    }
+    SREG = sreg;
+    return 0;
+}
+
+int epd_if_spi_queue_block(int dc, const unsigned char* data, unsigned int len) {
+    return epd_if_spi_queue(EPD_IF_SEGMENT_RAM, dc, data, 0, len);
+}
+
+int epd_if_spi_queue_block_P(int dc, const unsigned char* data, unsigned int len) {
+    return epd_if_spi_queue(EPD_IF_SEGMENT_PGM, dc, data, 0, len);
+}
+
+int epd_if_spi_queue_fill(int dc, unsigned char data, unsigned int len) {
+    return epd_if_spi_queue(EPD_IF_SEGMENT_FILL, dc, NULL, data, len);
+}
+
+void epd_if_spi_set_callback(epd_if_callback callback) {
+    epd_if_spi_callback = callback;
+}
+
+/**
+ *  @brief: the SPI can't receive on MOSI, so it is switched off and the
+ *          byte clocked in by hand, sampled after each rising SCK edge
+ */
+unsigned char epd_if_spi_read(void) {
+    unsigned char data = 0;
+
+    epd_if_spi_wait();
+    SPCR &= ~(1<<SPE);
+    DDRB &= ~(1<<PB3);
+    epd_if_digital_write(DC_PIN, HIGH);
+    epd_if_digital_write(CS_PIN, LOW);
+    for (unsigned char bit = 0; bit < 8; bit++) {
+        PORTB |= (1<<PB5);
+        data = (data << 1) | ((PINB >> PB3) & 1);
+        PORTB &= ~(1<<PB5);
+    }
+    epd_if_digital_write(CS_PIN, HIGH);
+    DDRB |= (1<<PB3);
+    SPCR |= (1<<SPE);
+    return data;
+}
+
+/**
+ *  @brief: claim the hardware SPI as a master at fosc/2
+ */
+void epd_if_bus_init(void) {
+    /* MOSI, SCK and SS must be outputs for the SPI master */
+    DDRB |= (1<<PB3) | (1<<PB5) | (1<<PB2);
+    /* fosc/2, 4 MHz at 8 MHz which is well inside the controller's limit */
+    SPCR = (1<<SPE) | (1<<MSTR);
+    SPSR = (1<<SPI2X);
+}
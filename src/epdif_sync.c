@@ -0,0 +1,44 @@
+/**
+ *  @filename   :   epdif_sync.c
+ *  @brief      :   Transmit queue for backends without a transmit interrupt
+ *
+ *  The queue calls transmit straight away through the backend's blocking
+ *  block transfers and run the callback before returning, so the queue is
+ *  never busy. Linked together with epdif_usart.c, epdif_bitbang.c and the
+ *  host backends.
+ */
+
+#include <stddef.h>
+
+#include "epdif.h"
+
+volatile unsigned char epd_if_spi_active;
+static epd_if_callback epd_if_spi_callback;
+
+static int epd_if_spi_queued(void) {
+    if (epd_if_spi_callback != NULL) {
+        epd_if_spi_callback();
+    }
+    return 0;
+}
+
+int epd_if_spi_queue_block(int dc, const unsigned char* data, unsigned int len) {
+    epd_if_spi_transfer_block(dc, data, len);
+    return epd_if_spi_queued();
+}
+
+int epd_if_spi_queue_block_P(int dc, const unsigned char* data, unsigned int len) {
+    epd_if_spi_transfer_block_P(dc, data, len);
+    return epd_if_spi_queued();
+}
+
+int epd_if_spi_queue_fill(int dc, unsigned char data, unsigned int len) {
+    epd_if_spi_transfer_fill(dc, data, len);
+    return epd_if_spi_queued();
+}
+
+void epd_if_spi_set_callback(epd_if_callback callback) {
+    epd_if_spi_callback = callback;
+}
+
+/* END OF FILE */
@@ -0,0 +1,107 @@
+/**
+ *  @filename   :   epdif_usart.c
+ *  @brief      :   EPD interface bus backend on USART0 in master SPI mode
+ *
+ *  Unlike SPDR the USART data register is double buffered, so the next byte
+ *  can be loaded while the current one shifts out and the bus runs at
+ *  fosc/2 without gaps between bytes.
+ *
+ *  Wiring: DIN = TXD0 (PD1), CLK = XCK0 (PD4). CS, DC, RST and BUSY come
+ *  from epdboard.h as for the SPI backend. USART0 is also the UART used by
+ *  uart.c, so call uart_init before printing and epd_if_bus_init before
+ *  talking to the panel again.
+ */
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+#include "epdif.h"
+
+const char epd_if_backend[] = "usart";
+
+/**
+ *  @brief: TXC0 is cleared at the start of every run and set once the last
+ *          byte has completely left the shift register.
+ */
+static inline void epd_if_usart_begin(int dc) {
+    epd_if_digital_write(DC_PIN, dc);
+    epd_if_digital_write(CS_PIN, LOW);
+    UCSR0A = (1<<TXC0);
+}
+
+static inline void epd_if_usart_end(void) {
+    while (!(UCSR0A & (1<<TXC0)));
+    epd_if_digital_write(CS_PIN, HIGH);
+}
+
+void epd_if_spi_transfer(unsigned char data) {
+    epd_if_digital_write(CS_PIN, LOW);
+    UCSR0A = (1<<TXC0);
+    UDR0 = data;
+    epd_if_usart_end();
+}
+
+void epd_if_spi_transfer_block(int dc, const unsigned char* data, unsigned int len) {
+    epd_if_usart_begin(dc);
+    while (len--) {
+        while (!(UCSR0A & (1<<UDRE0)));
+        UDR0 = *data++;
+    }
+    epd_if_usart_end();
+}
+
+void epd_if_spi_transfer_block_P(int dc, const unsigned char* data, unsigned int len) {
+    epd_if_usart_begin(dc);
+    while (len--) {
+        unsigned char next = pgm_read_byte(data++);
+        while (!(UCSR0A & (1<<UDRE0)));
+        UDR0 = next;
+    }
+    epd_if_usart_end();
+}
+
+void epd_if_spi_transfer_fill(int dc, unsigned char data, unsigned int len) {
+    epd_if_usart_begin(dc);
+    while (len--) {
+        while (!(UCSR0A & (1<<UDRE0)));
+        UDR0 = data;
+    }
+    epd_if_usart_end();
+}
+
+/**
+ *  @brief: the USART only transmits, so it lets go of TXD0 and XCK0 and
+ *          the byte is clocked in by hand, then the bus is claimed again
+ */
+unsigned char epd_if_spi_read(void) {
+    unsigned char data = 0;
+
+    UCSR0B = 0;
+    DDRD &= ~(1<<PD1);
+    PORTD &= ~(1<<PD4);
+    epd_if_digital_write(DC_PIN, HIGH);
+    epd_if_digital_write(CS_PIN, LOW);
+    for (unsigned char bit = 0; bit < 8; bit++) {
+        PORTD |= (1<<PD4);
+        data = (data << 1) | ((PIND >> PD1) & 1);
+        PORTD &= ~(1<<PD4);
+    }
+    epd_if_digital_write(CS_PIN, HIGH);
+    epd_if_bus_init();
+    return data;
+}
+
+/**
+ *  @brief: master SPI mode 0, MSB first, fosc/2
+ */
+void epd_if_bus_init(void) {
+    UBRR0 = 0;
+    /* XCK0 as an output selects master mode */
+    DDRD |= (1<<PD4);
+    UCSR0C = (1<<UMSEL01) | (1<<UMSEL00);
+    UCSR0B = (1<<TXEN0);
+    /* the baud rate must be set again once the transmitter is enabled */
+    UBRR0 = 0;
+}
+
+/* END OF FILE */
@@ -0,0 +1,287 @@
+/**
+ *  @filename   :   epdlut.c
+ *  @brief      :   Bundled waveform profiles for epd_set_profile
+ *
+ *  Each LUT row is one group: the level of four phases in the top byte
+ *  (two bits each, 01 drives towards black and 10 towards white), the four
+ *  phase lengths in frames and how often the group repeats.
+ */
+
+#include <avr/pgmspace.h>
+#include "epdlut.h"
+
+/**
+ *  Fast black/white: one 25 frame phase straight to the new colour,
+ *  whatever the old one was, so DTM1 needn't hold the previous frame.
+ *  No red and no cleaning flashes, in exchange for some ghosting.
+ */
+static const unsigned char epd_lut_fast_bw[EPD_LUTS_BYTES] PROGMEM = {
+    // VCOM_LUT
+    0x00, 0x19, 0x01, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00,
+    // W2W_LUT
+    0x80, 0x19, 0x01, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // B2W_LUT
+    0x80, 0x19, 0x01, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // W2B_LUT
+    0x40, 0x19, 0x01, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // B2B_LUT
+    0x40, 0x19, 0x01, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+/**
+ *  Cool black/white, 5 to 15 C: a 20 frame phase towards the opposite
+ *  colour shakes the particles loose before 25 frames to the new one.
+ */
+static const unsigned char epd_lut_cool_bw[EPD_LUTS_BYTES] PROGMEM = {
+    // VCOM_LUT
+    0x00, 0x14, 0x19, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00,
+    // W2W_LUT
+    0x60, 0x14, 0x19, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // B2W_LUT
+    0x60, 0x14, 0x19, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // W2B_LUT
+    0x90, 0x14, 0x19, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // B2B_LUT
+    0x90, 0x14, 0x19, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+/**
+ *  Cold black/white, below 5 C: the same two phases stretched to 30 and
+ *  40 frames and run twice, the particles move slowly in the cold.
+ */
+static const unsigned char epd_lut_cold_bw[EPD_LUTS_BYTES] PROGMEM = {
+    // VCOM_LUT
+    0x00, 0x1E, 0x28, 0x00, 0x00, 0x02,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00,
+    // W2W_LUT
+    0x60, 0x1E, 0x28, 0x00, 0x00, 0x02,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // B2W_LUT
+    0x60, 0x1E, 0x28, 0x00, 0x00, 0x02,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // W2B_LUT
+    0x90, 0x1E, 0x28, 0x00, 0x00, 0x02,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // B2B_LUT
+    0x90, 0x1E, 0x28, 0x00, 0x00, 0x02,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+/**
+ *  Black/white refresh that keeps red, tri-colour mode: there the LUT
+ *  registers go by the pixel's colour, B2W_LUT red, W2B_LUT white and
+ *  B2B_LUT black. Red pixels are left alone and the rest get the fast
+ *  25 frame drive, only sound while the red plane hasn't changed.
+ */
+static const unsigned char epd_lut_keep_red[EPD_LUTS_BYTES] PROGMEM = {
+    // VCOM_LUT
+    0x00, 0x19, 0x01, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00,
+    // W2W_LUT
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // B2W_LUT
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // W2B_LUT
+    0x80, 0x19, 0x01, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // B2B_LUT
+    0x40, 0x19, 0x01, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+/* the slow tri-colour waveform programmed into the panel */
+const struct epd_profile epd_profile_otp = {
+    EPD_PANEL_SETTING_OTP,
+    EPD_VCOM_DATA_INTERVAL_OTP,
+    EPD_PLL_50HZ,
+    NULL
+};
+
+/* black/white mode from the LUT registers, border left floating */
+const struct epd_profile epd_profile_fast_bw = {
+    EPD_PANEL_SETTING_OTP | EPD_PANEL_REG_LUT | EPD_PANEL_BW,
+    0x17,
+    EPD_PLL_50HZ,
+    epd_lut_fast_bw
+};
+
+const struct epd_profile epd_profile_cool_bw = {
+    EPD_PANEL_SETTING_OTP | EPD_PANEL_REG_LUT | EPD_PANEL_BW,
+    0x17,
+    EPD_PLL_50HZ,
+    epd_lut_cool_bw
+};
+
+const struct epd_profile epd_profile_cold_bw = {
+    EPD_PANEL_SETTING_OTP | EPD_PANEL_REG_LUT | EPD_PANEL_BW,
+    0x17,
+    EPD_PLL_50HZ,
+    epd_lut_cold_bw
+};
+
+/* tri-colour mode from the LUT registers, see epd_set_bw_refresh */
+const struct epd_profile epd_profile_keep_red = {
+    EPD_PANEL_SETTING_OTP | EPD_PANEL_REG_LUT,
+    EPD_VCOM_DATA_INTERVAL_OTP,
+    EPD_PLL_50HZ,
+    epd_lut_keep_red
+};
+
+/* the same waveforms at higher frame rates, faster and paler */
+const struct epd_profile epd_profile_otp_100hz = {
+    EPD_PANEL_SETTING_OTP,
+    EPD_VCOM_DATA_INTERVAL_OTP,
+    EPD_PLL_100HZ,
+    NULL
+};
+
+const struct epd_profile epd_profile_fast_bw_100hz = {
+    EPD_PANEL_SETTING_OTP | EPD_PANEL_REG_LUT | EPD_PANEL_BW,
+    0x17,
+    EPD_PLL_100HZ,
+    epd_lut_fast_bw
+};
+
+const struct epd_profile epd_profile_fast_bw_200hz = {
+    EPD_PANEL_SETTING_OTP | EPD_PANEL_REG_LUT | EPD_PANEL_BW,
+    0x17,
+    EPD_PLL_200HZ,
+    epd_lut_fast_bw
+};
+
+/* every bundled profile by name, e.g. for characterising a panel */
+const struct epd_named_profile epd_profiles[EPD_PROFILES] = {
+    { "otp",                &epd_profile_otp },
+    { "otp 100 Hz",         &epd_profile_otp_100hz },
+    { "keep red",           &epd_profile_keep_red },
+    { "cold b/w",           &epd_profile_cold_bw },
+    { "cool b/w",           &epd_profile_cool_bw },
+    { "fast b/w",           &epd_profile_fast_bw },
+    { "fast b/w 100 Hz",    &epd_profile_fast_bw_100hz },
+    { "fast b/w 200 Hz",    &epd_profile_fast_bw_200hz },
+};
+
+/* black/white by temperature, the fast waveform from 15 C up */
+const struct epd_temperature_band epd_temperature_bands_bw[EPD_TEMPERATURE_BANDS_BW] = {
+    { EPD_TEMPERATURE_UNKNOWN,  &epd_profile_cold_bw },
+    { 5,                        &epd_profile_cool_bw },
+    { 15,                       &epd_profile_fast_bw },
+};
+
+/* END OF FILE */
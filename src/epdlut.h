@@ -0,0 +1,35 @@
+/**
+ *  @filename   :   epdlut.h
+ *  @brief      :   Bundled waveform profiles for epd_set_profile
+ */
+
+#ifndef EPDLUT_H
+#define EPDLUT_H
+
+#include "epd2in13.h"
+
+extern const struct epd_profile epd_profile_otp;
+extern const struct epd_profile epd_profile_fast_bw;
+extern const struct epd_profile epd_profile_cool_bw;
+extern const struct epd_profile epd_profile_cold_bw;
+extern const struct epd_profile epd_profile_keep_red;
+extern const struct epd_profile epd_profile_otp_100hz;
+extern const struct epd_profile epd_profile_fast_bw_100hz;
+extern const struct epd_profile epd_profile_fast_bw_200hz;
+
+struct epd_named_profile {
+    const char* name;
+    const struct epd_profile* profile;
+};
+
+#define EPD_PROFILES                8
+
+extern const struct epd_named_profile epd_profiles[EPD_PROFILES];
+
+#define EPD_TEMPERATURE_BANDS_BW    3
+
+extern const struct epd_temperature_band epd_temperature_bands_bw[EPD_TEMPERATURE_BANDS_BW];
+
+#endif
+
+/* END OF FILE */
@@ -0,0 +1,215 @@
+/**
+ *  @filename   :   epdplan.c
+ *  @brief      :   Update planner choosing how to send a set of changes
+ *
+ *  Given the windows of an epd_regions batch and the whole new frame, the
+ *  planner estimates each way of getting it onto the panel as bus time
+ *  plus refresh time and runs the quickest:
+ *
+ *  windows     both planes of every window in one transaction
+ *  full        both planes of the whole frame
+ *  black       only the black plane of every window, when red is
+ *              unchanged, so the refresh can take epd_set_bw_refresh's
+ *              waveform or a black/white profile's
+ *
+ *  Bytes are counted before the band hashes leave anything out. Refresh
+ *  times come from a table of BUSY times measured per profile, the bus
+ *  time per byte from the uploads done so far. Both start from a guess.
+ *  Every decision is left in the planner with the estimates and the time
+ *  it really took and handed to the log callback.
+ */
+
+#include <string.h>
+#include "epdplan.h"
+
+const char* const epd_plan_names[EPD_PLAN_STRATEGIES] = { "windows", "full", "black" };
+
+/* a window cut out of a whole-frame source */
+struct epd_plan_crop {
+    const struct epd_source* frame;
+    unsigned int x;
+    unsigned int y;
+};
+
+static void epd_plan_crop_row(void* context, unsigned int row, unsigned char* buffer, unsigned int len) {
+    struct epd_plan_crop* crop = context;
+    unsigned char line[EPD_WIDTH / 8];
+
+    epd_source_read_row(crop->frame, crop->y + row, line, sizeof(line));
+    memcpy(buffer, line + crop->x / 8, len);
+}
+
+void epd_plan_init(struct epd_planner * planner, epd_plan_logger log) {
+    memset(planner, 0, sizeof(*planner));
+    planner->byte_ns = EPD_PLAN_BYTE_NS;
+    planner->log = log;
+}
+
+static struct epd_plan_refresh* epd_plan_find(struct epd_planner * planner, const struct epd_profile* profile) {
+    for (unsigned char i = 0; i < EPD_PLAN_PROFILES; i++) {
+        if (planner->refresh[i].samples != 0 && planner->refresh[i].profile == profile) {
+            return &planner->refresh[i];
+        }
+    }
+    return NULL;
+}
+
+static unsigned long epd_plan_refresh_ms(struct epd_planner * planner, const struct epd_profile* profile) {
+    struct epd_plan_refresh* refresh = epd_plan_find(planner, profile);
+
+    return refresh != NULL ? refresh->busy_ms : EPD_PLAN_REFRESH_MS;
+}
+
+/**
+ *  @brief: fold a measured refresh into the table, the first one counts
+ *          in full and later ones a quarter each
+ */
+static void epd_plan_learn_refresh(struct epd_planner * planner, const struct epd_profile* profile, unsigned long busy_ms) {
+    struct epd_plan_refresh* refresh = epd_plan_find(planner, profile);
+
+    if (refresh == NULL) {
+        refresh = &planner->refresh[planner->refresh_next];
+        planner->refresh_next = (planner->refresh_next + 1) % EPD_PLAN_PROFILES;
+        refresh->profile = profile;
+        refresh->busy_ms = busy_ms;
+        refresh->samples = 1;
+        return;
+    }
+    refresh->busy_ms = (3 * refresh->busy_ms + busy_ms) / 4;
+    if (refresh->samples != 0xff) {
+        refresh->samples++;
+    }
+}
+
+/**
+ *  @brief: add a measured upload to the totals, halving both once they
+ *          pass EPD_PLAN_KEEP_BYTES so older uploads fade out and the sums
+ *          stay small. The division is split so us * 1000 never overflows.
+ */
+static void epd_plan_learn_upload(struct epd_planner * planner, unsigned long bytes, unsigned long us) {
+    unsigned long whole;
+
+    planner->upload_bytes += bytes;
+    planner->upload_us += us;
+    if (planner->upload_bytes > EPD_PLAN_KEEP_BYTES) {
+        planner->upload_bytes /= 2;
+        planner->upload_us /= 2;
+    }
+    if (planner->upload_bytes < EPD_PLAN_LEARN_BYTES) {
+        return;
+    }
+    whole = planner->upload_us / planner->upload_bytes;
+    if (whole > EPD_PLAN_BYTE_NS_MAX / 1000) {
+        planner->byte_ns = EPD_PLAN_BYTE_NS_MAX;
+        return;
+    }
+    whole = whole * 1000 + planner->upload_us % planner->upload_bytes * 1000 / planner->upload_bytes;
+    planner->byte_ns = whole > EPD_PLAN_BYTE_NS_MAX ? EPD_PLAN_BYTE_NS_MAX : whole;
+}
+
+/**
+ *  @brief: the profile a refresh will run with, see epd_prepare_refresh
+ */
+static const struct epd_profile* epd_plan_profile(struct epd * epd, int red_sent) {
+    int bw = epd->profile != NULL && (epd->profile->panel_setting & EPD_PANEL_BW);
+
+    if (!red_sent && !epd->red_dirty && !bw && epd->bw_refresh != NULL) {
+        return epd->bw_refresh;
+    }
+    return epd->profile;
+}
+
+static unsigned long epd_plan_estimate(
+    struct epd_planner * planner,
+    struct epd * epd,
+    unsigned long bytes,
+    int red_sent
+) {
+    return bytes * planner->byte_ns / 1000000UL + epd_plan_refresh_ms(planner, epd_plan_profile(epd, red_sent));
+}
+
+/**
+ *  @brief: open a transaction with the windows of the batch cut out of the
+ *          new frame, red may be NULL. epd_commit refreshes.
+ */
+static void epd_plan_send_windows(
+    struct epd * epd,
+    struct epd_regions * regions,
+    const struct epd_source* black,
+    const struct epd_source* red
+) {
+    epd_begin(epd);
+    for (unsigned char i = 0; i < regions->count; i++) {
+        struct epd_rect* rect = &regions->rects[i];
+        struct epd_plan_crop black_crop = { black, rect->x, rect->y };
+        struct epd_plan_crop red_crop = { red, rect->x, rect->y };
+        struct epd_source black_window;
+        struct epd_source red_window;
+
+        epd_source_rows(&black_window, epd_plan_crop_row, &black_crop);
+        epd_source_rows(&red_window, epd_plan_crop_row, &red_crop);
+        epd_set_window(epd, &black_window, red != NULL ? &red_window : NULL,
+            rect->x, rect->y, rect->w, rect->l);
+    }
+}
+
+/**
+ *  @brief: get the new frame onto the panel the quickest way and refresh.
+ *          regions holds the changed rectangles and is cleared, black and
+ *          red are the whole new frame. red_changed 0 promises the red
+ *          plane is the same as on the panel.
+ */
+void epd_plan_update(
+    struct epd_planner * planner,
+    struct epd * epd,
+    struct epd_regions * regions,
+    const struct epd_source* black,
+    const struct epd_source* red,
+    int red_changed
+) {
+    unsigned long plane = (unsigned long)(EPD_WIDTH / 8) * EPD_HEIGHT;
+    unsigned long window_bytes = regions->count * EPD_REGION_WINDOW_BYTES;
+    unsigned long start;
+    unsigned long upload;
+    unsigned char best = EPD_PLAN_FULL;
+
+    for (unsigned char i = 0; i < regions->count; i++) {
+        window_bytes += (unsigned long)(regions->rects[i].w / 8) * regions->rects[i].l;
+    }
+    planner->bytes[EPD_PLAN_WINDOWS] = 2 * window_bytes;
+    planner->bytes[EPD_PLAN_FULL] = 2 * plane + 2;
+    planner->bytes[EPD_PLAN_BLACK] = window_bytes;
+    planner->estimate_ms[EPD_PLAN_WINDOWS] = epd_plan_estimate(planner, epd, planner->bytes[EPD_PLAN_WINDOWS], 1);
+    planner->estimate_ms[EPD_PLAN_FULL] = epd_plan_estimate(planner, epd, planner->bytes[EPD_PLAN_FULL], 1);
+    planner->estimate_ms[EPD_PLAN_BLACK] = red_changed ? EPD_PLAN_IMPOSSIBLE :
+        epd_plan_estimate(planner, epd, planner->bytes[EPD_PLAN_BLACK], 0);
+    for (unsigned char i = 0; i < EPD_PLAN_STRATEGIES; i++) {
+        if (planner->estimate_ms[i] < planner->estimate_ms[best] ||
+                (planner->estimate_ms[i] == planner->estimate_ms[best] && planner->bytes[i] < planner->bytes[best])) {
+            best = i;
+        }
+    }
+    planner->strategy = best;
+
+    start = epd_if_millis();
+    upload = epd_if_micros();
+    if (best == EPD_PLAN_FULL) {
+        epd_set_window(epd, black, red, 0, 0, EPD_WIDTH, EPD_HEIGHT);
+        epd_plan_learn_upload(planner, planner->bytes[best], epd_if_micros() - upload);
+        epd_display_frame(epd);
+    } else {
+        epd_plan_send_windows(epd, regions, black, best == EPD_PLAN_WINDOWS ? red : NULL);
+        epd_plan_learn_upload(planner, planner->bytes[best], epd_if_micros() - upload);
+        epd_commit(epd);
+    }
+    if (epd->busy_us != 0) {
+        epd_plan_learn_refresh(planner, epd->loaded, epd->busy_us / 1000);
+    }
+    planner->actual_ms = epd_if_millis() - start;
+    epd_regions_clear(regions);
+    if (planner->log != NULL) {
+        planner->log(planner);
+    }
+}
+
+/* END OF FILE */
@@ -0,0 +1,64 @@
+/**
+ *  @filename   :   epdplan.h
+ *  @brief      :   Update planner choosing how to send a set of changes
+ */
+
+#ifndef EPDPLAN_H
+#define EPDPLAN_H
+
+#include "epd2in13.h"
+#include "epdregion.h"
+
+#define EPD_PLAN_WINDOWS            0   // both planes through partial windows
+#define EPD_PLAN_FULL               1   // both planes in full
+#define EPD_PLAN_BLACK              2   // black windows only, red is unchanged
+#define EPD_PLAN_STRATEGIES         3
+
+#define EPD_PLAN_PROFILES           4   // refresh times learned
+#define EPD_PLAN_REFRESH_MS         15000   // guess for a profile not seen yet
+#define EPD_PLAN_BYTE_NS            2500    // guess until uploads are measured
+#define EPD_PLAN_LEARN_BYTES        16384   // measured bytes before they count
+#define EPD_PLAN_KEEP_BYTES         32768   // halve the totals past this
+#define EPD_PLAN_BYTE_NS_MAX        0xffff  // byte_ns is 16 bits on AVR
+#define EPD_PLAN_IMPOSSIBLE         0xffffffffUL
+
+/* BUSY time of a refresh with one profile, averaged over the last few */
+struct epd_plan_refresh {
+    const struct epd_profile* profile;
+    unsigned long busy_ms;
+    unsigned char samples;      // 0 when the slot is free
+};
+
+struct epd_planner;
+
+typedef void (*epd_plan_logger)(const struct epd_planner * planner);
+
+struct epd_planner {
+    struct epd_plan_refresh refresh[EPD_PLAN_PROFILES];
+    unsigned char refresh_next; // slot to reuse when all are taken
+    unsigned int byte_ns;       // bus time per byte
+    unsigned long upload_bytes; // measured lately, see EPD_PLAN_KEEP_BYTES
+    unsigned long upload_us;
+    epd_plan_logger log;        // called after every update, may be NULL
+    // the last update
+    unsigned char strategy;
+    unsigned long bytes[EPD_PLAN_STRATEGIES];
+    unsigned long estimate_ms[EPD_PLAN_STRATEGIES];     // EPD_PLAN_IMPOSSIBLE when ruled out
+    unsigned long actual_ms;
+};
+
+extern const char* const epd_plan_names[EPD_PLAN_STRATEGIES];
+
+void epd_plan_init(struct epd_planner * planner, epd_plan_logger log);
+void epd_plan_update(
+    struct epd_planner * planner,
+    struct epd * epd,
+    struct epd_regions * regions,
+    const struct epd_source* black,
+    const struct epd_source* red,
+    int red_changed
+);
+
+#endif
+
+/* END OF FILE */
@@ -0,0 +1,230 @@
+/**
+ *  @filename   :   epdqueue.c
+ *  @brief      :   Queue of region updates with priorities and deadlines
+ *
+ *  A region that has changed is queued under a tag with a priority and
+ *  optionally a deadline; the upload callback draws it when its turn
+ *  comes, so a region queued again before then goes out once. From
+ *  epd_queue_poll:
+ *
+ *  urgent      go out right away in a refresh of their own with
+ *              urgent_profile, a partial one when there is only one.
+ *              Nothing low is uploaded, so only they change.
+ *  low         wait until the oldest has waited batch_ms, or until a
+ *              deadline would be missed by waiting any longer, and then
+ *              all go out in one full refresh with the panel's profile.
+ *
+ *  A deadline counts as soon as the refresh it needs would end after it,
+ *  going by the last batch refresh measured. Both profiles must be
+ *  black/white or both tri-colour, see epd_set_profile; on a tri-colour
+ *  panel urgent_profile can be NULL with epd_set_bw_refresh providing the
+ *  fast waveform. Refreshes block like epd_display_frame does, so an
+ *  urgent update queued during a batch waits for it.
+ */
+
+#include <stddef.h>
+#include "epdqueue.h"
+
+void epd_queue_init(
+    struct epd_queue * queue,
+    const struct epd_profile* urgent_profile,
+    unsigned long batch_ms,
+    epd_queue_upload upload,
+    epd_queue_logger log,
+    void* context
+) {
+    queue->count = 0;
+    queue->urgent_profile = urgent_profile;
+    queue->batch_ms = batch_ms;
+    queue->batch_refresh_ms = EPD_QUEUE_REFRESH_MS;
+    queue->upload = upload;
+    queue->log = log;
+    queue->context = context;
+    queue->urgent_refreshes = 0;
+    queue->batch_refreshes = 0;
+    queue->visible = 0;
+    queue->missed = 0;
+    queue->worst_wait_ms[EPD_PRIORITY_LOW] = 0;
+    queue->worst_wait_ms[EPD_PRIORITY_URGENT] = 0;
+}
+
+/**
+ *  @brief: queue a region, x and w in pixels of any alignment. A tag
+ *          already queued keeps its place and grows to cover both
+ *          windows, the higher priority and the earlier deadline.
+ *          Returns -1 when the queue is full.
+ */
+int epd_queue_add(
+    struct epd_queue * queue,
+    unsigned char tag,
+    unsigned int x,
+    unsigned int y,
+    unsigned int w,
+    unsigned int l,
+    unsigned char priority,
+    unsigned long deadline_ms
+) {
+    unsigned long now = epd_if_millis();
+    struct epd_update* update;
+
+    for (unsigned char i = 0; i < queue->count; i++) {
+        update = &queue->updates[i];
+        if (update->tag == tag) {
+            struct epd_rect* rect = &update->rect;
+            unsigned int right = rect->x + rect->w > x + w ? rect->x + rect->w : x + w;
+            unsigned int bottom = rect->y + rect->l > y + l ? rect->y + rect->l : y + l;
+
+            rect->x = rect->x < x ? rect->x : x;
+            rect->y = rect->y < y ? rect->y : y;
+            rect->w = right - rect->x;
+            rect->l = bottom - rect->y;
+            if (priority > update->priority) {
+                update->priority = priority;
+            }
+            if (deadline_ms != 0) {
+                deadline_ms += now - update->queued_ms;
+                if (update->deadline_ms == 0 || deadline_ms < update->deadline_ms) {
+                    update->deadline_ms = deadline_ms;
+                }
+            }
+            return 0;
+        }
+    }
+    if (queue->count == EPD_QUEUE_SIZE) {
+        return -1;
+    }
+    update = &queue->updates[queue->count++];
+    update->rect.x = x;
+    update->rect.y = y;
+    update->rect.w = w;
+    update->rect.l = l;
+    update->tag = tag;
+    update->priority = priority;
+    update->queued_ms = now;
+    update->deadline_ms = deadline_ms;
+    return 0;
+}
+
+/**
+ *  @brief: report the updates of a priority as visible and drop them
+ */
+static void epd_queue_visible(struct epd_queue * queue, unsigned char priority) {
+    unsigned long now = epd_if_millis();
+    unsigned char kept = 0;
+
+    for (unsigned char i = 0; i < queue->count; i++) {
+        struct epd_update* update = &queue->updates[i];
+
+        if (update->priority != priority) {
+            queue->updates[kept++] = *update;
+            continue;
+        }
+        update->waited_ms = now - update->queued_ms;
+        update->missed = update->deadline_ms != 0 && update->waited_ms > update->deadline_ms;
+        queue->visible++;
+        queue->missed += update->missed;
+        if (update->waited_ms > queue->worst_wait_ms[priority]) {
+            queue->worst_wait_ms[priority] = update->waited_ms;
+        }
+        if (queue->log != NULL) {
+            queue->log(update, queue->context);
+        }
+    }
+    queue->count = kept;
+}
+
+/**
+ *  @brief: upload and refresh every update of a priority, returns how
+ *          many there were
+ */
+static unsigned char epd_queue_refresh(struct epd_queue * queue, struct epd * epd, unsigned char priority) {
+    const struct epd_profile* profile = epd->profile;
+    struct epd_update* last = NULL;
+    unsigned char count = 0;
+
+    for (unsigned char i = 0; i < queue->count; i++) {
+        if (queue->updates[i].priority == priority) {
+            last = &queue->updates[i];
+            queue->upload(epd, last, queue->context);
+            count++;
+        }
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    if (priority == EPD_PRIORITY_URGENT) {
+        if (queue->urgent_profile != NULL && queue->urgent_profile != profile) {
+            epd_set_profile(epd, queue->urgent_profile);
+        }
+        if (count == 1) {
+            epd_display_window(epd, last->rect.x, last->rect.y, last->rect.w, last->rect.l);
+        } else {
+            epd_display_frame(epd);
+        }
+        if (epd->profile != profile) {
+            epd_set_profile(epd, profile);
+        }
+        queue->urgent_refreshes++;
+    } else {
+        epd_display_frame(epd);
+        if (epd->busy_us != 0) {
+            queue->batch_refresh_ms = epd->busy_us / 1000;
+        }
+        queue->batch_refreshes++;
+    }
+    epd_queue_visible(queue, priority);
+    return count;
+}
+
+/**
+ *  @brief: 1 when the low updates can't wait any longer
+ */
+static int epd_queue_batch_due(struct epd_queue * queue) {
+    unsigned long now = epd_if_millis();
+
+    for (unsigned char i = 0; i < queue->count; i++) {
+        struct epd_update* update = &queue->updates[i];
+        unsigned long waited_ms = now - update->queued_ms;
+
+        if (update->priority != EPD_PRIORITY_LOW) {
+            continue;
+        }
+        if (queue->batch_ms != 0 && waited_ms >= queue->batch_ms) {
+            return 1;
+        }
+        if (update->deadline_ms != 0 && waited_ms + queue->batch_refresh_ms >= update->deadline_ms) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ *  @brief: refresh everything queued now, urgent first. Returns how many
+ *          updates became visible.
+ */
+int epd_queue_flush(struct epd_queue * queue, struct epd * epd) {
+    int visible = epd_queue_refresh(queue, epd, EPD_PRIORITY_URGENT);
+
+    return visible + epd_queue_refresh(queue, epd, EPD_PRIORITY_LOW);
+}
+
+/**
+ *  @brief: call from the main loop along with epd_poll. Returns how many
+ *          updates became visible.
+ */
+int epd_queue_poll(struct epd_queue * queue, struct epd * epd) {
+    int visible;
+
+    if (queue->count == 0 || epd_is_busy(epd)) {
+        return 0;
+    }
+    visible = epd_queue_refresh(queue, epd, EPD_PRIORITY_URGENT);
+    if (epd_queue_batch_due(queue)) {
+        visible += epd_queue_refresh(queue, epd, EPD_PRIORITY_LOW);
+    }
+    return visible;
+}
+
+/* END OF FILE */
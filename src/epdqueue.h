@@ -0,0 +1,74 @@
+/**
+ *  @filename   :   epdqueue.h
+ *  @brief      :   Queue of region updates with priorities and deadlines
+ */
+
+#ifndef EPDQUEUE_H
+#define EPDQUEUE_H
+
+#include "epd2in13.h"
+#include "epdregion.h"
+
+#define EPD_QUEUE_SIZE              8
+#define EPD_QUEUE_REFRESH_MS        15000   // guess until a batch is measured
+
+#define EPD_PRIORITY_LOW            0       // batched
+#define EPD_PRIORITY_URGENT         1       // a refresh of its own
+
+struct epd_update {
+    struct epd_rect rect;
+    unsigned char tag;              // the caller's name for the region
+    unsigned char priority;
+    unsigned long queued_ms;
+    unsigned long deadline_ms;      // after queued_ms, 0 for none
+    // once visible
+    unsigned long waited_ms;
+    unsigned char missed;           // 1 when it took longer than deadline_ms
+};
+
+/* upload the current contents of an update's window, e.g. epd_set_partial_window */
+typedef void (*epd_queue_upload)(struct epd * epd, const struct epd_update * update, void* context);
+/* called for every update once it is visible */
+typedef void (*epd_queue_logger)(const struct epd_update * update, void* context);
+
+struct epd_queue {
+    struct epd_update updates[EPD_QUEUE_SIZE];
+    unsigned char count;
+    const struct epd_profile* urgent_profile;   // NULL to keep the panel's
+    unsigned long batch_ms;         // oldest low update waits this long, 0 for ever
+    unsigned long batch_refresh_ms; // last batch refresh, for the deadlines
+    epd_queue_upload upload;
+    epd_queue_logger log;           // may be NULL
+    void* context;
+    // report
+    unsigned long urgent_refreshes;
+    unsigned long batch_refreshes;
+    unsigned long visible;
+    unsigned long missed;
+    unsigned long worst_wait_ms[2]; // per priority
+};
+
+void epd_queue_init(
+    struct epd_queue * queue,
+    const struct epd_profile* urgent_profile,
+    unsigned long batch_ms,
+    epd_queue_upload upload,
+    epd_queue_logger log,
+    void* context
+);
+int epd_queue_add(
+    struct epd_queue * queue,
+    unsigned char tag,
+    unsigned int x,
+    unsigned int y,
+    unsigned int w,
+    unsigned int l,
+    unsigned char priority,
+    unsigned long deadline_ms
+);
+int epd_queue_flush(struct epd_queue * queue, struct epd * epd);
+int epd_queue_poll(struct epd_queue * queue, struct epd * epd);
+
+#endif
+
+/* END OF FILE */
@@ -0,0 +1,148 @@
+/**
+ *  @filename   :   epdregion.c
+ *  @brief      :   Dirty rectangle collection for partial window updates
+ *
+ *  Rectangles are snapped to whole bytes in x, the controller's window
+ *  granularity, and merged greedily: while some pair costs more as two
+ *  windows than as their bounding box, the pair saving the most becomes
+ *  one window. A window costs its bytes on every plane sent plus a fixed
+ *  window_cost, so a large overhead favours few windows and a small one
+ *  favours tight ones. The result is the window list to send, e.g. one
+ *  epd_set_partial_window_black or epd_add_window per rects[i].
+ */
+
+#include "epdregion.h"
+
+static unsigned long epd_region_cost(struct epd_regions * regions, const struct epd_rect * rect) {
+    return (unsigned long)regions->planes * (rect->w / 8) * rect->l + regions->window_cost;
+}
+
+static void epd_region_union(struct epd_rect * out, const struct epd_rect * a, const struct epd_rect * b) {
+    unsigned int x1 = a->x + a->w > b->x + b->w ? a->x + a->w : b->x + b->w;
+    unsigned int y1 = a->y + a->l > b->y + b->l ? a->y + a->l : b->y + b->l;
+
+    out->x = a->x < b->x ? a->x : b->x;
+    out->y = a->y < b->y ? a->y : b->y;
+    out->w = x1 - out->x;
+    out->l = y1 - out->y;
+}
+
+/**
+ *  @brief: what merging rects i and j saves, negative when it costs more
+ */
+static long epd_region_gain(struct epd_regions * regions, unsigned char i, unsigned char j) {
+    struct epd_rect merged;
+
+    epd_region_union(&merged, &regions->rects[i], &regions->rects[j]);
+    return (long)(epd_region_cost(regions, &regions->rects[i]) + epd_region_cost(regions, &regions->rects[j]))
+        - (long)epd_region_cost(regions, &merged);
+}
+
+/**
+ *  @brief: merge the pair with the best gain into one window. Returns 0
+ *          when no pair gains anything, unless force is set.
+ */
+static int epd_region_merge_best(struct epd_regions * regions, int force) {
+    unsigned char best_i = 0;
+    unsigned char best_j = 0;
+    long best = 0;
+    int found = 0;
+
+    for (unsigned char i = 0; i < regions->count; i++) {
+        for (unsigned char j = i + 1; j < regions->count; j++) {
+            long gain = epd_region_gain(regions, i, j);
+            if ((force && !found) || gain > best) {
+                best = gain;
+                best_i = i;
+                best_j = j;
+                found = 1;
+            }
+        }
+    }
+    if (!found || (!force && best <= 0)) {
+        return 0;
+    }
+    epd_region_union(&regions->rects[best_i], &regions->rects[best_i], &regions->rects[best_j]);
+    regions->rects[best_j] = regions->rects[--regions->count];
+    return 1;
+}
+
+/**
+ *  @brief: start with no regions. planes is how many planes each window
+ *          sends (1 or 2) and window_cost the fixed cost of a window in
+ *          bytes, EPD_REGION_WINDOW_BYTES inside a transaction and
+ *          EPD_REGION_WINDOW_BYTES + EPD_REGION_DELAY_BYTES outside one.
+ */
+void epd_regions_init(struct epd_regions * regions, unsigned char planes, unsigned int window_cost) {
+    regions->planes = planes;
+    regions->window_cost = window_cost;
+    regions->rects_added = 0;
+    regions->windows_sent = 0;
+    regions->cost_sent = 0;
+    regions->cost_separate = 0;
+    regions->cost_bounds = 0;
+    regions->count = 0;
+    regions->separate_cost = 0;
+    regions->bounds.w = 0;
+}
+
+/**
+ *  @brief: mark a rectangle dirty, x and w in pixels of any alignment
+ */
+void epd_regions_add(struct epd_regions * regions, unsigned int x, unsigned int y, unsigned int w, unsigned int l) {
+    struct epd_rect rect;
+
+    if (w == 0 || l == 0) {
+        return;
+    }
+    rect.x = x & ~7u;
+    rect.w = ((x + w + 7) & ~7u) - rect.x;
+    rect.y = y;
+    rect.l = l;
+
+    regions->rects_added++;
+    regions->separate_cost += epd_region_cost(regions, &rect);
+    if (regions->bounds.w == 0) {
+        regions->bounds = rect;
+    } else {
+        epd_region_union(&regions->bounds, &regions->bounds, &rect);
+    }
+
+    if (regions->count == EPD_REGIONS_MAX) {
+        epd_region_merge_best(regions, 1);
+    }
+    regions->rects[regions->count++] = rect;
+    while (epd_region_merge_best(regions, 0));
+}
+
+/**
+ *  @brief: the cost of sending the current windows
+ */
+unsigned long epd_regions_cost(struct epd_regions * regions) {
+    unsigned long cost = 0;
+
+    for (unsigned char i = 0; i < regions->count; i++) {
+        cost += epd_region_cost(regions, &regions->rects[i]);
+    }
+    return cost;
+}
+
+/**
+ *  @brief: the windows have been sent, count them into the totals and
+ *          start over. cost_separate - cost_sent is what merging saved over
+ *          a window per rectangle, cost_bounds - cost_sent what the tight
+ *          windows saved over one bounding box per batch.
+ */
+void epd_regions_clear(struct epd_regions * regions) {
+    if (regions->count != 0) {
+        regions->windows_sent += regions->count;
+        regions->cost_sent += epd_regions_cost(regions);
+        regions->cost_separate += regions->separate_cost;
+        regions->cost_bounds += epd_region_cost(regions, &regions->bounds);
+    }
+    regions->count = 0;
+    regions->separate_cost = 0;
+    regions->bounds.w = 0;
+}
+
+/* END OF FILE */
@@ -0,0 +1,47 @@
+/**
+ *  @filename   :   epdregion.h
+ *  @brief      :   Dirty rectangle collection for partial window updates
+ */
+
+#ifndef EPDREGION_H
+#define EPDREGION_H
+
+#define EPD_REGIONS_MAX             8
+
+// Cost model in bytes on the bus. Each window adds PARTIAL_IN, PARTIAL_WINDOW
+// with its 7 bytes, the DTM command and PARTIAL_OUT. Outside a transaction
+// it also pays two 2 ms upload delays, about 1800 bytes at fosc/2.
+#define EPD_REGION_WINDOW_BYTES     11
+#define EPD_REGION_DELAY_BYTES      1800
+
+/* a window on the panel, the arguments of epd_set_partial_window */
+struct epd_rect {
+    unsigned int x;
+    unsigned int y;
+    unsigned int w;
+    unsigned int l;
+};
+
+struct epd_regions {
+    struct epd_rect rects[EPD_REGIONS_MAX];
+    unsigned char count;
+    unsigned char planes;           // planes sent per window
+    unsigned int window_cost;       // fixed cost of a window in bytes
+    unsigned long separate_cost;    // this batch, every rectangle on its own
+    struct epd_rect bounds;         // this batch, everything in one window
+    // totals over the batches ended by epd_regions_clear
+    unsigned long rects_added;
+    unsigned long windows_sent;
+    unsigned long cost_sent;
+    unsigned long cost_separate;
+    unsigned long cost_bounds;
+};
+
+void epd_regions_init(struct epd_regions * regions, unsigned char planes, unsigned int window_cost);
+void epd_regions_add(struct epd_regions * regions, unsigned int x, unsigned int y, unsigned int w, unsigned int l);
+unsigned long epd_regions_cost(struct epd_regions * regions);
+void epd_regions_clear(struct epd_regions * regions);
+
+#endif
+
+/* END OF FILE */
@@ -0,0 +1,22 @@
+/**
+ *  @filename   :   pgmspace.h
+ *  @brief      :   Host stand-in for avr-libc's <avr/pgmspace.h>
+ *
+ *  On the host flash is ordinary memory, so PROGMEM data is read directly.
+ */
+
+#ifndef HOST_PGMSPACE_H
+#define HOST_PGMSPACE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s)                 (s)
+#define pgm_read_byte(addr)     (*(const uint8_t *)(addr))
+#define pgm_read_word(addr)     (*(const uint16_t *)(addr))
+#define memcpy_P                memcpy
+
+#endif
+
+/* END OF FILE */
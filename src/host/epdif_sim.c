@@ -0,0 +1,307 @@
+/**
+ *  @filename   :   epdif_sim.c
+ *  @brief      :   Host simulator backend for the EPD interface
+ *
+ *  Models the parts of the controller the driver uses: both SRAM planes,
+ *  partial windows, the BUSY line and deep sleep. Time is virtual and only
+ *  moves through epd_if_delay_ms, so a multi-second refresh costs nothing.
+ *  Every DISPLAY_REFRESH writes the panel to sim-NNN.ppm.
+ *  With register LUTs a refresh takes as many frames as VCOM_LUT adds up
+ *  to, in black/white mode the image is DTM2. PLL_CONTROL sets the frame
+ *  time, the OTP waveform's SIM_REFRESH_MS is at the default 50 Hz.
+ *  The temperature sensor reads whatever epd_if_host_set_temperature set.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "epd2in13.h"
+
+#define SIM_PLANE_BYTES     (EPD_WIDTH / 8 * EPD_HEIGHT)
+#define SIM_POWER_ON_MS     80
+#define SIM_POWER_OFF_MS    30
+#define SIM_REFRESH_MS      15000
+#define SIM_FRAME_US        20000       // 50 Hz, the PLL_CONTROL default
+#define SIM_SENSE_MS        5
+
+const char epd_if_backend[] = "sim";
+
+static unsigned char sim_black[SIM_PLANE_BYTES];
+static unsigned char sim_red[SIM_PLANE_BYTES];
+static unsigned char* sim_plane;
+static unsigned char sim_command;
+static unsigned char sim_params[8];
+static unsigned int sim_param_count;
+static int sim_dc;
+static int sim_rst = HIGH;
+static int sim_asleep;
+static int sim_partial;
+static unsigned int sim_x0, sim_x1, sim_y0, sim_y1;
+static unsigned int sim_x, sim_y;
+static unsigned long sim_time_ms;
+static unsigned long sim_busy_until_ms;
+static int sim_frames;
+static epd_if_idle_callback sim_idle;
+static unsigned long sim_idle_armed_ms;
+static unsigned char sim_panel_setting = EPD_PANEL_SETTING_OTP;
+static unsigned long sim_lut_frames;
+static unsigned long sim_group_frames;
+static unsigned long sim_frame_us = SIM_FRAME_US;
+static signed char sim_temperature = 25;
+static unsigned char sim_read[2];
+static unsigned int sim_read_count;
+
+/**
+ *  @brief: move virtual time on, firing an armed idle callback once the
+ *          panel stops being busy
+ */
+static void sim_advance(unsigned long ms) {
+    sim_time_ms += ms;
+    if (sim_idle != NULL && sim_time_ms >= sim_busy_until_ms) {
+        epd_if_idle_callback callback = sim_idle;
+        sim_idle = NULL;
+        callback((sim_time_ms - sim_idle_armed_ms) * 1000);
+    }
+}
+
+static void sim_busy_for(unsigned long ms) {
+    sim_busy_until_ms = sim_time_ms + ms;
+}
+
+static void sim_window_reset(void) {
+    sim_x0 = 0;
+    sim_x1 = EPD_WIDTH - 1;
+    sim_y0 = 0;
+    sim_y1 = EPD_HEIGHT - 1;
+}
+
+/**
+ *  @brief: write the panel as a PPM, red wins over black wins over white
+ */
+static void sim_write_frame(void) {
+    char name[32];
+    FILE* f;
+
+    snprintf(name, sizeof(name), "sim-%03d.ppm", sim_frames++);
+    f = fopen(name, "wb");
+    if (f == NULL) {
+        perror(name);
+        return;
+    }
+    fprintf(f, "P6\n%d %d\n255\n", EPD_WIDTH, EPD_HEIGHT);
+    for (int y = 0; y < EPD_HEIGHT; y++) {
+        for (int x = 0; x < EPD_WIDTH; x++) {
+            int i = y * (EPD_WIDTH / 8) + x / 8;
+            unsigned char mask = 0x80 >> (x % 8);
+            if (sim_panel_setting & EPD_PANEL_BW) {
+                unsigned char c = sim_red[i] & mask ? 0xff : 0x00;
+                fputc(c, f); fputc(c, f); fputc(c, f);
+            } else if (!(sim_red[i] & mask)) {
+                fputc(0xff, f); fputc(0x00, f); fputc(0x00, f);
+            } else if (!(sim_black[i] & mask)) {
+                fputc(0x00, f); fputc(0x00, f); fputc(0x00, f);
+            } else {
+                fputc(0xff, f); fputc(0xff, f); fputc(0xff, f);
+            }
+        }
+    }
+    fclose(f);
+    fprintf(stderr, "sim: %8lu ms refresh -> %s\n", sim_time_ms, name);
+}
+
+static void sim_start_command(unsigned char command) {
+    sim_command = command;
+    sim_param_count = 0;
+    sim_plane = NULL;
+    switch (command) {
+    case POWER_ON:
+        sim_busy_for(SIM_POWER_ON_MS);
+        break;
+    case POWER_OFF:
+        sim_busy_for(SIM_POWER_OFF_MS);
+        break;
+    case DATA_START_TRANSMISSION_1:
+    case DATA_START_TRANSMISSION_2:
+        sim_plane = command == DATA_START_TRANSMISSION_1 ? sim_black : sim_red;
+        sim_x = sim_x0;
+        sim_y = sim_y0;
+        break;
+    case DISPLAY_REFRESH:
+        sim_write_frame();
+        if (sim_panel_setting & EPD_PANEL_REG_LUT) {
+            sim_busy_for(sim_lut_frames * sim_frame_us / 1000);
+        } else {
+            sim_busy_for(SIM_REFRESH_MS * sim_frame_us / SIM_FRAME_US);
+        }
+        break;
+    case VCOM_LUT:
+        sim_lut_frames = 0;
+        sim_group_frames = 0;
+        break;
+    case TEMPERATURE_SENSOR_CALIBRATION:
+        /* D[10:3] then D[2:0] in the top bits, eighths of a degree */
+        sim_read[0] = (unsigned char)sim_temperature;
+        sim_read[1] = 0;
+        sim_read_count = 0;
+        sim_busy_for(SIM_SENSE_MS);
+        break;
+    case PARTIAL_IN:
+        sim_partial = 1;
+        break;
+    case PARTIAL_OUT:
+        sim_partial = 0;
+        sim_window_reset();
+        break;
+    }
+}
+
+static void sim_data(unsigned char data) {
+    if (sim_plane != NULL) {
+        if (sim_y <= sim_y1 && sim_y < EPD_HEIGHT && sim_x < EPD_WIDTH) {
+            sim_plane[sim_y * (EPD_WIDTH / 8) + sim_x / 8] = data;
+        }
+        sim_x += 8;
+        if (sim_x > sim_x1) {
+            sim_x = sim_x0;
+            sim_y++;
+        }
+        return;
+    }
+    if (sim_param_count < sizeof(sim_params)) {
+        sim_params[sim_param_count] = data;
+    }
+    sim_param_count++;
+    if (sim_command == PARTIAL_WINDOW && sim_param_count == 7 && sim_partial) {
+        sim_x0 = sim_params[0] & 0xf8;
+        sim_x1 = sim_params[1] | 0x07;
+        sim_y0 = (sim_params[2] << 8) | sim_params[3];
+        sim_y1 = (sim_params[4] << 8) | sim_params[5];
+    }
+    if (sim_command == PANEL_SETTING && sim_param_count == 1) {
+        sim_panel_setting = data;
+    }
+    if (sim_command == PLL_CONTROL && sim_param_count == 1) {
+        switch (data) {
+        case EPD_PLL_100HZ: sim_frame_us = 10000; break;
+        case EPD_PLL_150HZ: sim_frame_us = 6667; break;
+        case EPD_PLL_200HZ: sim_frame_us = 5000; break;
+        default:            sim_frame_us = SIM_FRAME_US; break;
+        }
+    }
+    if (sim_command == VCOM_LUT && sim_param_count <= 42) {
+        /* each group of 6: levels, four phase lengths, repeat count */
+        unsigned int at = (sim_param_count - 1) % 6;
+        if (at == 0) {
+            sim_group_frames = 0;
+        } else if (at < 5) {
+            sim_group_frames += data;
+        } else {
+            sim_lut_frames += sim_group_frames * data;
+        }
+    }
+    if (sim_command == DEEP_SLEEP && data == 0xA5) {
+        sim_asleep = 1;
+    }
+}
+
+static void sim_byte(unsigned char data) {
+    if (sim_asleep || sim_rst == LOW) {
+        return;
+    }
+    if (sim_dc == LOW) {
+        sim_start_command(data);
+    } else {
+        sim_data(data);
+    }
+}
+
+void epd_if_digital_write(int pin, int value) {
+    if (pin == DC_PIN) {
+        sim_dc = value;
+    } else if (pin == RST_PIN) {
+        if (sim_rst == LOW && value == HIGH) {
+            sim_asleep = 0;
+            sim_partial = 0;
+            sim_window_reset();
+        }
+        sim_rst = value;
+    }
+}
+
+int epd_if_digital_read(int pin) {
+    if (pin == BUSY_PIN) {
+        return sim_time_ms < sim_busy_until_ms ? LOW : HIGH;
+    }
+    return LOW;
+}
+
+void epd_if_delay_ms(unsigned int delaytime) {
+    sim_advance(delaytime);
+}
+
+unsigned long epd_if_millis(void) {
+    return sim_time_ms;
+}
+
+unsigned long epd_if_micros(void) {
+    return sim_time_ms * 1000;
+}
+
+unsigned long epd_if_wait_until_idle(void) {
+    unsigned long start = sim_time_ms;
+
+    if (sim_time_ms < sim_busy_until_ms) {
+        sim_advance(sim_busy_until_ms - sim_time_ms);
+    }
+    return (sim_time_ms - start) * 1000;
+}
+
+void epd_if_on_idle(epd_if_idle_callback callback) {
+    sim_idle = callback;
+    sim_idle_armed_ms = sim_time_ms;
+}
+
+void epd_if_spi_transfer(unsigned char data) {
+    sim_byte(data);
+}
+
+void epd_if_spi_transfer_block(int dc, const unsigned char* data, unsigned int len) {
+    sim_dc = dc;
+    while (len--) {
+        sim_byte(*data++);
+    }
+}
+
+void epd_if_spi_transfer_block_P(int dc, const unsigned char* data, unsigned int len) {
+    epd_if_spi_transfer_block(dc, data, len);
+}
+
+void epd_if_spi_transfer_fill(int dc, unsigned char data, unsigned int len) {
+    sim_dc = dc;
+    while (len--) {
+        sim_byte(data);
+    }
+}
+
+unsigned char epd_if_spi_read(void) {
+    if (sim_command != TEMPERATURE_SENSOR_CALIBRATION || sim_read_count >= sizeof(sim_read)) {
+        return 0xff;
+    }
+    return sim_read[sim_read_count++];
+}
+
+void epd_if_host_set_temperature(signed char celsius) {
+    sim_temperature = celsius;
+}
+
+void epd_if_bus_init(void) {
+}
+
+int epd_if_init(void) {
+    memset(sim_black, 0xff, sizeof(sim_black));
+    memset(sim_red, 0xff, sizeof(sim_red));
+    sim_window_reset();
+    return 0;
+}
+
+/* END OF FILE */
@@ -0,0 +1,118 @@
+/**
+ *  @filename   :   epdif_trace.c
+ *  @brief      :   Host backend printing every EPD bus transaction
+ *
+ *  One line per command, data byte, burst, reset edge and delay on stdout,
+ *  for diffing the command stream before and after driver changes. The
+ *  panel is always idle.
+ */
+
+#include <stdio.h>
+
+#include "epdif.h"
+
+#define TRACE_INLINE_BYTES  8
+
+const char epd_if_backend[] = "trace";
+
+static int trace_dc;
+static unsigned long trace_time_ms;
+static signed char trace_temperature = 25;
+
+static void trace_burst(const char* kind, const unsigned char* data, unsigned int len) {
+    printf("%s %4u:", kind, len);
+    for (unsigned int i = 0; i < len && i < TRACE_INLINE_BYTES; i++) {
+        printf(" %02x", data[i]);
+    }
+    printf(len > TRACE_INLINE_BYTES ? " ...\n" : "\n");
+}
+
+void epd_if_digital_write(int pin, int value) {
+    if (pin == DC_PIN) {
+        trace_dc = value;
+    } else if (pin == RST_PIN) {
+        printf("reset %s\n", value == LOW ? "low" : "high");
+    }
+}
+
+int epd_if_digital_read(int pin) {
+    return HIGH;
+}
+
+void epd_if_delay_ms(unsigned int delaytime) {
+    printf("delay %u ms\n", delaytime);
+    trace_time_ms += delaytime;
+}
+
+unsigned long epd_if_millis(void) {
+    return trace_time_ms;
+}
+
+unsigned long epd_if_micros(void) {
+    return trace_time_ms * 1000;
+}
+
+unsigned long epd_if_wait_until_idle(void) {
+    printf("wait idle\n");
+    return 0;
+}
+
+/**
+ *  @brief: the traced panel is never busy, so the callback fires as soon
+ *          as the command that was armed for has gone out
+ */
+static epd_if_idle_callback trace_idle;
+
+void epd_if_on_idle(epd_if_idle_callback callback) {
+    printf("on idle\n");
+    trace_idle = callback;
+}
+
+static void trace_fire_idle(void) {
+    epd_if_idle_callback callback = trace_idle;
+
+    if (callback != NULL) {
+        trace_idle = NULL;
+        callback(0);
+    }
+}
+
+void epd_if_spi_transfer(unsigned char data) {
+    printf("%s 0x%02x\n", trace_dc == LOW ? "cmd " : "data", data);
+    if (trace_dc == LOW) {
+        trace_fire_idle();
+    }
+}
+
+void epd_if_spi_transfer_block(int dc, const unsigned char* data, unsigned int len) {
+    trace_dc = dc;
+    trace_burst(dc == LOW ? "cmd  ram " : "data ram ", data, len);
+}
+
+void epd_if_spi_transfer_block_P(int dc, const unsigned char* data, unsigned int len) {
+    trace_dc = dc;
+    trace_burst(dc == LOW ? "cmd  pgm " : "data pgm ", data, len);
+}
+
+void epd_if_spi_transfer_fill(int dc, unsigned char data, unsigned int len) {
+    trace_dc = dc;
+    printf("%s %4u: %02x\n", dc == LOW ? "cmd  fill" : "data fill", len, data);
+}
+
+unsigned char epd_if_spi_read(void) {
+    printf("read 0x%02x\n", (unsigned char)trace_temperature);
+    return (unsigned char)trace_temperature;
+}
+
+void epd_if_host_set_temperature(signed char celsius) {
+    trace_temperature = celsius;
+}
+
+void epd_if_bus_init(void) {
+}
+
+int epd_if_init(void) {
+    return 0;
+}
+
+/* END OF FILE */
@@ -0,0 +1,508 @@
+/**
+ *  @filename   :   sim.c
+ *  @brief      :   Runs the driver on the host against the sim or trace backend
+ *
+ *  Build with `make sim` (or `make sim SIM_IF=trace`) and run bin/sim-<if>.
+ *  Replays the demo start-up followed by a full frame upload.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "demo-imagedata.h"
+#include "epd2in13.h"
+#include "epdlut.h"
+#include "epdpaint.h"
+#include "epdghost.h"
+#include "epdplan.h"
+#include "epdcoalesce.h"
+#include "epdqueue.h"
+#include "epdregion.h"
+
+#define COLORED     0
+#define UNCOLORED   1
+
+/* stand-in for the epdpaint work of a real frame, in virtual time */
+#define RENDER_BANDS    8
+#define RENDER_BAND_MS  10
+
+unsigned char image[1120];
+
+static const char* sim_states[] = {
+    "off", "deep sleep", "standby", "powered", "refreshing"
+};
+
+/**
+ *  @brief: let virtual time pass with the main loop polling the driver
+ */
+static void sim_idle_for(struct epd * epd, unsigned long ms) {
+    for (unsigned long t = 0; t < ms; t += 100) {
+        epd_if_delay_ms(100);
+        epd_poll(epd);
+    }
+    printf("after %lu ms idle: %s\n", ms, sim_states[epd->state]);
+}
+
+/**
+ *  @brief: render a frame in bands, polling the driver between them
+ */
+static void sim_render(struct epd * epd, struct paint * paint, const char* text) {
+    paint_Clear(paint, UNCOLORED);
+    paint_DrawStringAt(paint, 0, 0, text, &Font24, COLORED);
+    for (int band = 0; band < RENDER_BANDS; band++) {
+        epd_if_delay_ms(RENDER_BAND_MS);
+        epd_poll(epd);
+    }
+}
+
+/**
+ *  @brief: upload the rendered frame and wait for the refresh, printing
+ *          how long it took from start to the refresh starting
+ */
+static void sim_show(struct epd * epd, struct paint * paint, unsigned long start) {
+    epd_set_partial_window_black(
+        epd,
+        paint_GetImage(paint),
+        epd->width - paint->width - 32,
+        8,
+        paint_GetWidth(paint),
+        paint_GetHeight(paint)
+    );
+    if (!epd->dirty) {
+        printf("nothing changed, refresh skipped\n");
+        return;
+    }
+    epd_display_frame_async(epd, NULL);
+    printf("refresh started after %lu ms\n", epd_if_millis() - start);
+    while (epd_is_busy(epd)) {
+        epd_if_delay_ms(10);
+    }
+}
+
+static void sim_update(struct epd * epd, struct paint * paint, const char* text) {
+    unsigned long start = epd_if_millis();
+
+    sim_render(epd, paint, text);
+    sim_show(epd, paint, start);
+}
+
+/**
+ *  @brief: like sim_update, with the panel coming up while the frame renders
+ */
+static void sim_update_overlapped(struct epd * epd, struct paint * paint, const char* text) {
+    unsigned long start = epd_if_millis();
+
+    epd_power_on_async(epd, NULL);
+    sim_render(epd, paint, text);
+    sim_show(epd, paint, start);
+}
+
+/**
+ *  @brief: a counter on the fast waveform with a clean refresh when the
+ *          ghosting budget runs out, and one more while idle
+ */
+static void sim_ghosting(struct epd * epd, struct paint * paint) {
+    struct epd_ghosting ghosting;
+    char text[4];
+
+    epd_ghosting_init(&ghosting, &epd_profile_fast_bw, &epd_profile_cool_bw, 3, 1024, 20000);
+    epd_set_profile(epd, &epd_profile_fast_bw);
+    epd_clear_frame_memory(epd);
+    for (int n = 0; n < 6; n++) {
+        snprintf(text, sizeof(text), "%d", n);
+        paint_Clear(paint, UNCOLORED);
+        paint_DrawStringAt(paint, 0, 0, text, &Font16, COLORED);
+        epd_set_partial_window_black(epd, paint_GetImage(paint), 8, 8, 16, 32);
+        epd_ghosting_refresh(&ghosting, epd);
+        printf("ghosting: %d refresh busy for %lu us\n", n, epd->busy_us);
+    }
+    for (int t = 0; t < 300 && !epd_ghosting_poll(&ghosting, epd); t++) {
+        epd_if_delay_ms(100);
+    }
+    printf("ghosting: %lu fast, %lu clean, %lu of them while idle\n",
+        ghosting.fast_refreshes, ghosting.clean_refreshes, ghosting.idle_cleans);
+    epd_set_profile(epd, NULL);
+}
+
+static void sim_plan_log(const struct epd_planner * planner) {
+    printf("plan: %-7s", epd_plan_names[planner->strategy]);
+    for (unsigned char i = 0; i < EPD_PLAN_STRATEGIES; i++) {
+        if (planner->estimate_ms[i] == EPD_PLAN_IMPOSSIBLE) {
+            printf(" %s -", epd_plan_names[i]);
+        } else {
+            printf(" %s %lu B %lu ms", epd_plan_names[i], planner->bytes[i], planner->estimate_ms[i]);
+        }
+    }
+    printf(", took %lu ms\n", planner->actual_ms);
+}
+
+/**
+ *  @brief: flip the bits of a rectangle of a frame and mark it changed
+ */
+static void sim_plan_change(struct epd_regions * regions, unsigned char * frame,
+        unsigned int x, unsigned int y, unsigned int w, unsigned int l) {
+    for (unsigned int row = y; row < y + l; row++) {
+        for (unsigned int col = x / 8; col < (x + w) / 8; col++) {
+            frame[row * (EPD_WIDTH / 8) + col] ^= 0xff;
+        }
+    }
+    epd_regions_add(regions, x, y, w, l);
+}
+
+/**
+ *  @brief: a black-only change twice, a small red change and a change
+ *          all over, each sent the way the planner finds quickest
+ */
+static void sim_plan(struct epd * epd) {
+    static unsigned char black[EPD_WIDTH / 8 * EPD_HEIGHT];
+    static unsigned char red[EPD_WIDTH / 8 * EPD_HEIGHT];
+    struct epd_planner planner;
+    struct epd_regions regions;
+    struct epd_source black_source;
+    struct epd_source red_source;
+
+    memcpy(black, IMAGE_BLACK, sizeof(black));
+    memcpy(red, IMAGE_RED, sizeof(red));
+    epd_source_ram(&black_source, black);
+    epd_source_ram(&red_source, red);
+    epd_plan_init(&planner, sim_plan_log);
+    epd_regions_init(&regions, 2, EPD_REGION_WINDOW_BYTES);
+    epd_set_bw_refresh(epd, &epd_profile_keep_red);
+    epd_display_frame_source(epd, &black_source, &red_source);
+
+    sim_plan_change(&regions, black, 8, 40, 24, 24);
+    epd_plan_update(&planner, epd, &regions, &black_source, &red_source, 0);
+    sim_plan_change(&regions, black, 8, 40, 24, 24);
+    epd_plan_update(&planner, epd, &regions, &black_source, &red_source, 0);
+    sim_plan_change(&regions, red, 64, 100, 16, 16);
+    epd_plan_update(&planner, epd, &regions, &black_source, &red_source, 1);
+    sim_plan_change(&regions, black, 0, 0, EPD_WIDTH, EPD_HEIGHT);
+    sim_plan_change(&regions, red, 0, 0, EPD_WIDTH, EPD_HEIGHT);
+    epd_plan_update(&planner, epd, &regions, &black_source, &red_source, 1);
+    epd_set_bw_refresh(epd, NULL);
+}
+
+/* what the coalescer's upload callback draws */
+struct sim_counter {
+    struct paint * paint;
+    int value;
+};
+
+static void sim_coalesce_upload(struct epd * epd, const struct epd_rect * rect, void* context) {
+    struct sim_counter * counter = context;
+    char text[4];
+
+    snprintf(text, sizeof(text), "%d", counter->value);
+    paint_Clear(counter->paint, UNCOLORED);
+    paint_DrawStringAt(counter->paint, 0, 0, text, &Font16, COLORED);
+    epd_set_partial_window_black(epd, paint_GetImage(counter->paint), rect->x, rect->y, rect->w, rect->l);
+}
+
+/**
+ *  @brief: a burst of counter changes 200 ms apart, then a few more while
+ *          the first batch is still refreshing on the OTP waveform
+ */
+static void sim_coalesce(struct epd * epd, struct paint * paint) {
+    static const unsigned long marks_ms[] = { 0, 200, 400, 600, 800, 4000, 7000, 10000 };
+    struct sim_counter counter = { paint, 0 };
+    struct epd_coalescer coalescer;
+    unsigned char next = 0;
+
+    epd_clear_frame_memory(epd);
+    epd_coalesce_init(&coalescer, 1, 500, 5000, sim_coalesce_upload, &counter);
+    for (unsigned long t = 0; t < 40000; t += 100) {
+        if (next < sizeof(marks_ms) / sizeof(marks_ms[0]) && t >= marks_ms[next]) {
+            counter.value++;
+            epd_coalesce_mark(&coalescer, 8, 8, 16, 32);
+            next++;
+        }
+        if (epd_coalesce_poll(&coalescer, epd)) {
+            printf("coalesce: %u changes visible at %lu ms, %lu ms after the last, %lu after the first\n",
+                coalescer.visible_changes, t, coalescer.latency_ms, coalescer.wait_ms);
+        }
+        epd_if_delay_ms(100);
+        epd_poll(epd);
+    }
+    printf("coalesce: %lu changes in %lu refreshes, worst latency %lu ms, worst wait %lu ms\n",
+        coalescer.changes, coalescer.batches, coalescer.worst_latency_ms, coalescer.worst_wait_ms);
+}
+
+/* the regions of the queue demo, drawn by tag */
+#define SIM_FOOTER  0
+#define SIM_ALARM   1
+#define SIM_STATUS  2
+
+struct sim_regions_shown {
+    struct paint * paint;
+    int values[3];
+};
+
+static void sim_queue_upload(struct epd * epd, const struct epd_update * update, void* context) {
+    struct sim_regions_shown * shown = context;
+    char text[4];
+
+    snprintf(text, sizeof(text), "%d", shown->values[update->tag]);
+    paint_Clear(shown->paint, UNCOLORED);
+    paint_DrawStringAt(shown->paint, 0, 0, text, &Font16, COLORED);
+    epd_set_partial_window_black(epd, paint_GetImage(shown->paint),
+        update->rect.x, update->rect.y, update->rect.w, update->rect.l);
+}
+
+static void sim_queue_log(const struct epd_update * update, void* context) {
+    static const char* names[] = { "footer", "alarm", "status" };
+
+    printf("queue: %-6s %s waited %lu ms%s\n", names[update->tag],
+        update->priority == EPD_PRIORITY_URGENT ? "urgent" : "low   ",
+        update->waited_ms, update->missed ? ", deadline missed" : "");
+}
+
+/**
+ *  @brief: a footer and a status line batched on the OTP waveform, and an
+ *          alarm twice in a partial refresh of its own, the second time
+ *          with a deadline too short for it
+ */
+static void sim_queue(struct epd * epd, struct paint * paint) {
+    static const struct {
+        unsigned long at_ms;
+        unsigned char tag;
+        unsigned char priority;
+        unsigned long deadline_ms;
+    } changes[] = {
+        { 0, SIM_FOOTER, EPD_PRIORITY_LOW, 0 },
+        { 1000, SIM_FOOTER, EPD_PRIORITY_LOW, 0 },
+        { 3000, SIM_ALARM, EPD_PRIORITY_URGENT, 1000 },
+        { 5000, SIM_STATUS, EPD_PRIORITY_LOW, 25000 },
+        { 8000, SIM_ALARM, EPD_PRIORITY_URGENT, 300 },
+    };
+    static const struct epd_rect rects[] = { { 8, 176, 16, 32 }, { 8, 8, 16, 32 }, { 48, 96, 16, 32 } };
+    struct sim_regions_shown shown = { paint, { 0, 0, 0 } };
+    struct epd_queue queue;
+    unsigned char next = 0;
+
+    epd_set_bw_refresh(epd, &epd_profile_keep_red);
+    epd_clear_frame_memory(epd);
+    epd_display_frame(epd);
+    epd_queue_init(&queue, NULL, 20000, sim_queue_upload, sim_queue_log, &shown);
+    for (unsigned long t = 0; t < 40000; t += 100) {
+        while (next < sizeof(changes) / sizeof(changes[0]) && t >= changes[next].at_ms) {
+            const struct epd_rect * rect = &rects[changes[next].tag];
+
+            shown.values[changes[next].tag]++;
+            epd_queue_add(&queue, changes[next].tag, rect->x, rect->y, rect->w, rect->l,
+                changes[next].priority, changes[next].deadline_ms);
+            next++;
+        }
+        epd_queue_poll(&queue, epd);
+        epd_if_delay_ms(100);
+        epd_poll(epd);
+    }
+    printf("queue: %lu visible in %lu urgent and %lu batch refreshes, %lu deadlines missed\n",
+        queue.visible, queue.urgent_refreshes, queue.batch_refreshes, queue.missed);
+    printf("queue: worst wait %lu ms urgent, %lu ms low\n",
+        queue.worst_wait_ms[EPD_PRIORITY_URGENT], queue.worst_wait_ms[EPD_PRIORITY_LOW]);
+    epd_set_bw_refresh(epd, NULL);
+}
+
+/**
+ *  @brief: the windows a batch of scattered dirty rectangles turns into
+ */
+static void sim_regions(unsigned int window_cost) {
+    static const struct epd_rect dirty[] = {
+        { 3, 10, 12, 16 }, { 20, 12, 10, 16 }, { 40, 10, 9, 18 },
+        { 3, 120, 20, 16 }, { 90, 190, 6, 8 }, { 88, 200, 10, 6 }
+    };
+    struct epd_regions regions;
+
+    epd_regions_init(&regions, 1, window_cost);
+    for (unsigned int i = 0; i < sizeof(dirty) / sizeof(dirty[0]); i++) {
+        epd_regions_add(&regions, dirty[i].x, dirty[i].y, dirty[i].w, dirty[i].l);
+    }
+    printf("window cost %u:", window_cost);
+    for (unsigned char i = 0; i < regions.count; i++) {
+        struct epd_rect * r = &regions.rects[i];
+        printf(" %ux%u@%u,%u", r->w, r->l, r->x, r->y);
+    }
+    epd_regions_clear(&regions);
+    printf("\n  cost %lu, separate %lu, bounding box %lu\n",
+        regions.cost_sent, regions.cost_separate, regions.cost_bounds);
+}
+
+/**
+ *  @brief: an 8x8 checkerboard, synthesised a row at a time
+ */
+static void sim_checkerboard(void* context, unsigned int row, unsigned char* buffer, unsigned int len) {
+    for (unsigned int i = 0; i < len; i++) {
+        buffer[i] = ((row / 8 + i) & 1) ? 0xFF : 0x00;
+    }
+}
+
+static void sim_refreshed(struct epd * epd) {
+    printf("async refresh done after %lu us\n", epd->busy_us);
+}
+
+int main() {
+    struct epd epd;
+    struct paint paint;
+
+    printf("epd2in13 on the %s backend\n", epd_if_backend);
+    if (epd_init(&epd) != 0) {
+        return 1;
+    }
+    paint_init(&paint, image, 0, 0);
+    epd_clear_frame_memory(&epd);
+
+    paint_SetRotate(&paint, ROTATE_90);
+    paint_SetWidth(&paint, 16);
+    paint_SetHeight(&paint, 200);
+    paint_Clear(&paint, UNCOLORED);
+    paint_DrawStringAt(&paint, 0, 0, "enter a string:", &Font16, COLORED);
+    epd_set_partial_window_black(
+        &epd,
+        paint_GetImage(&paint),
+        epd.width - paint.width,
+        8,
+        paint_GetWidth(&paint),
+        paint_GetHeight(&paint)
+    );
+    epd_display_frame(&epd);
+
+    printf("partial refresh busy for %lu us\n", epd.busy_us);
+
+    epd_display_frame_direct(&epd, IMAGE_BLACK, IMAGE_RED);
+    printf("full refresh busy for %lu us\n", epd.busy_us);
+
+    /* the main loop keeps working in 10 ms steps while the panel refreshes,
+       same frame again so the refresh has to be forced */
+    epd_force_refresh(&epd);
+    epd_display_frame_async(&epd, sim_refreshed);
+    int steps = 0;
+    while (epd_is_busy(&epd)) {
+        epd_if_delay_ms(10);
+        steps++;
+    }
+    printf("main loop ran %d steps during the refresh\n", steps);
+
+    /* close updates reuse the powered panel, idle ones power down */
+    epd_set_idle_timeouts(&epd, 20000, 120000);
+    paint_SetWidth(&paint, 24);
+    sim_update(&epd, &paint, "Got: 1");
+    sim_idle_for(&epd, 1000);
+    sim_update(&epd, &paint, "Got: 2");
+    sim_idle_for(&epd, 30000);
+    sim_update(&epd, &paint, "Got: 3");
+    sim_idle_for(&epd, 150000);
+    sim_update(&epd, &paint, "Got: 4");
+
+    /* the same from deep sleep with reset and POWER_ON under the rendering */
+    sim_idle_for(&epd, 150000);
+    sim_update_overlapped(&epd, &paint, "Got: 5");
+
+    /* the band hashes narrow updates to what changed, or drop them */
+    sim_update(&epd, &paint, "Got: 6");
+    sim_update(&epd, &paint, "Got: 6");
+
+    /* two fields uploaded back to back and shown with a single refresh */
+    unsigned long start = epd_if_millis();
+    epd_begin(&epd);
+    paint_Clear(&paint, UNCOLORED);
+    paint_DrawStringAt(&paint, 0, 0, "Got: 7", &Font24, COLORED);
+    epd_add_window(&epd, paint_GetImage(&paint), NULL,
+        epd.width - paint.width - 32, 8, paint_GetWidth(&paint), paint_GetHeight(&paint));
+    paint_Clear(&paint, UNCOLORED);
+    paint_DrawStringAt(&paint, 0, 0, "Sum: 28", &Font24, COLORED);
+    epd_add_window(&epd, NULL, paint_GetImage(&paint),
+        epd.width - paint.width - 64, 8, paint_GetWidth(&paint), paint_GetHeight(&paint));
+    epd_commit(&epd);
+    printf("transaction of 2 fields took %lu ms\n", epd_if_millis() - start);
+
+    /* a whole frame generated row by row, without a frame buffer */
+    struct epd_source black;
+    struct epd_source red;
+    epd_source_rows(&black, sim_checkerboard, NULL);
+    epd_source_fill(&red, 0xFF);
+    epd_display_frame_source(&epd, &black, &red);
+
+    /* windows at any x, the second shares a byte column with the first */
+    epd_clear_frame_memory(&epd);
+    epd_begin(&epd);
+    paint_SetWidth(&paint, 16);
+    paint_SetHeight(&paint, 32);
+    paint_Clear(&paint, UNCOLORED);
+    paint_DrawStringAt(&paint, 0, 0, "45", &Font16, COLORED);
+    epd_add_window(&epd, paint_GetImage(&paint), NULL, 45, 8, 16, 32);
+    paint_Clear(&paint, UNCOLORED);
+    paint_DrawStringAt(&paint, 0, 0, "61", &Font16, COLORED);
+    epd_add_window(&epd, paint_GetImage(&paint), NULL, 61, 8, 16, 32);
+    epd_commit(&epd);
+
+    /* a transaction refreshed over its bounding box, only its gates scanning */
+    epd_set_gate_scan(&epd, EPD_GATE_SCAN_INSIDE);
+    epd_begin(&epd);
+    paint_Clear(&paint, UNCOLORED);
+    paint_DrawStringAt(&paint, 0, 0, "63", &Font16, COLORED);
+    epd_add_window(&epd, paint_GetImage(&paint), NULL, 61, 8, 16, 32);
+    paint_Clear(&paint, UNCOLORED);
+    paint_DrawStringAt(&paint, 0, 0, "8", &Font16, COLORED);
+    epd_add_window(&epd, paint_GetImage(&paint), NULL, 8, 100, 16, 32);
+    epd_commit(&epd);
+    epd_set_gate_scan(&epd, EPD_GATE_SCAN_ALL);
+    printf("transaction refresh busy for %lu us\n", epd.busy_us);
+
+    /* a digit refreshed on its own, only its gates scanning */
+    epd_set_gate_scan(&epd, EPD_GATE_SCAN_INSIDE);
+    paint_Clear(&paint, UNCOLORED);
+    paint_DrawStringAt(&paint, 0, 0, "62", &Font16, COLORED);
+    epd_set_partial_window_black(&epd, paint_GetImage(&paint), 61, 8, 16, 32);
+    epd_display_window(&epd, 61, 8, 16, 32);
+    epd_set_gate_scan(&epd, EPD_GATE_SCAN_ALL);
+    printf("window refresh busy for %lu us\n", epd.busy_us);
+
+    /* the fast black/white waveform against the OTP one */
+    epd_set_profile(&epd, &epd_profile_fast_bw);
+    epd_display_frame_direct(&epd, IMAGE_BLACK, IMAGE_RED);
+    printf("fast b/w refresh busy for %lu us\n", epd.busy_us);
+    epd_set_profile(&epd, NULL);
+    epd_display_frame_direct(&epd, IMAGE_BLACK, IMAGE_RED);
+    printf("otp refresh busy for %lu us\n", epd.busy_us);
+
+    /* black/white waveforms picked by the panel's temperature */
+    epd_set_temperature_bands(&epd, epd_temperature_bands_bw, EPD_TEMPERATURE_BANDS_BW, 60000);
+    for (signed char celsius = 0; celsius <= 20; celsius += 10) {
+        epd_if_host_set_temperature(celsius);
+        epd_read_temperature(&epd);
+        epd_force_refresh(&epd);
+        epd_display_frame_direct(&epd, IMAGE_BLACK, NULL);
+        printf("%d C: band %u, refresh busy for %lu us\n",
+            epd.temperature, epd.temperature_band, epd.busy_us);
+    }
+    epd_set_temperature_bands(&epd, NULL, 0, 0);
+    epd_set_profile(&epd, NULL);
+
+    /* a black-only change keeps the red and skips its waveform */
+    epd_set_bw_refresh(&epd, &epd_profile_keep_red);
+    epd_display_frame_direct(&epd, IMAGE_BLACK, IMAGE_RED);
+    printf("red changed, refresh busy for %lu us\n", epd.busy_us);
+    paint_Clear(&paint, UNCOLORED);
+    paint_DrawStringAt(&paint, 0, 0, "20", &Font16, COLORED);
+    epd_set_partial_window_black(&epd, paint_GetImage(&paint), 8, 8, 16, 32);
+    epd_display_frame(&epd);
+    printf("black only, refresh busy for %lu us\n", epd.busy_us);
+    epd_set_bw_refresh(&epd, NULL);
+
+    sim_ghosting(&epd, &paint);
+    sim_plan(&epd);
+    sim_coalesce(&epd, &paint);
+    sim_queue(&epd, &paint);
+
+    /* the same dirty rectangles under both cost models */
+    sim_regions(EPD_REGION_WINDOW_BYTES);
+    sim_regions(EPD_REGION_WINDOW_BYTES + EPD_REGION_DELAY_BYTES);
+
+    epd_sleep_async(&epd, NULL);
+    while (epd_is_busy(&epd)) {
+        epd_if_delay_ms(10);
+    }
+    return 0;
+}
+
+/* END OF FILE */